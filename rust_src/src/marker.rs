@@ -10,7 +10,7 @@ use crate::{
     buffers::{current_buffer, LispBufferRef},
     lisp::{defsubr, ExternalPtr, LispMiscRef, LispObject},
     multibyte::multibyte_chars_in_text,
-    remacs_sys::{allocate_misc, set_point_both, Fmake_marker},
+    remacs_sys::{allocate_misc, buf_bytechar_index_find, set_point_both, Fmake_marker},
     remacs_sys::{equal_kind, EmacsInt, Lisp_Buffer, Lisp_Marker, Lisp_Misc_Type, Lisp_Type},
     remacs_sys::{Qinteger_or_marker_p, Qmarkerp, Qnil},
     threads::ThreadState,
@@ -25,6 +25,15 @@ const MARKER_DEBUG: bool = true;
 #[cfg(not(MARKER_DEBUG))]
 const MARKER_DEBUG: bool = false;
 
+// When converting between character and byte positions, the walk over
+// the buffer's markers stops once a known position lies within
+// `distance` characters of the target, and `distance` grows with every
+// marker looked at.  Considering a marker costs about as much as
+// scanning a few characters, so this bounds the walk in buffers that
+// carry thousands of markers instead of visiting all of them.
+const BYTECHAR_DISTANCE_INITIAL: isize = 100;
+const BYTECHAR_DISTANCE_INCREMENT: isize = 50;
+
 impl LispMarkerRef {
     pub fn charpos(self) -> Option<isize> {
         match self.buffer() {
@@ -675,14 +684,25 @@ pub extern "C" fn buf_charpos_to_bytepos(b: *mut Lisp_Buffer, charpos: isize) ->
         consider_known!(buffer_ref.cached_charpos, buffer_ref.cached_bytepos);
     }
 
-    for m in buffer_ref.markers().iter() {
+    let mut distance = BYTECHAR_DISTANCE_INITIAL;
+    for m in buffer_ref.markers().into_iter().flat_map(LispMarkerRef::iter) {
         consider_known!(m.charpos_or_error(), m.bytepos_or_error());
-        // If we are down to a range of 50 chars,
+        // If we are within DISTANCE chars of a known position,
         // don't bother checking any other markers;
         // scan the intervening chars directly now.
-        if best_above - best_below < 50 {
+        if best_above - charpos < distance || charpos - best_below < distance {
             break;
         }
+        distance += BYTECHAR_DISTANCE_INCREMENT;
+    }
+
+    // If nothing known is close, ask the buffer's position index,
+    // which is cheaper than scanning this far.
+    if charpos - best_below > 5000 && best_above - charpos > 5000 {
+        let mut indexed = 0;
+        let mut indexed_byte = 0;
+        unsafe { buf_bytechar_index_find(b, charpos, false, &mut indexed, &mut indexed_byte) };
+        consider_known!(indexed, indexed_byte);
     }
 
     if charpos - best_below < best_above - charpos {
@@ -786,14 +806,25 @@ pub unsafe extern "C" fn buf_bytepos_to_charpos(b: *mut Lisp_Buffer, bytepos: is
         consider_known!(buffer_ref.cached_bytepos, buffer_ref.cached_charpos);
     }
 
-    for m in buffer_ref.markers().iter() {
+    let mut distance = BYTECHAR_DISTANCE_INITIAL;
+    for m in buffer_ref.markers().into_iter().flat_map(LispMarkerRef::iter) {
         consider_known!(m.bytepos_or_error(), m.charpos_or_error());
-        // If we are down to a range of 50 chars,
+        // If we are within DISTANCE bytes of a known position,
         // don't bother checking any other markers;
         // scan the intervening chars directly now.
-        if best_above - best_below < 50 {
+        if best_above_byte - bytepos < distance || bytepos - best_below_byte < distance {
             break;
         }
+        distance += BYTECHAR_DISTANCE_INCREMENT;
+    }
+
+    // If nothing known is close, ask the buffer's position index,
+    // which is cheaper than scanning this far.
+    if bytepos - best_below_byte > 5000 && best_above_byte - bytepos > 5000 {
+        let mut indexed = 0;
+        let mut indexed_byte = 0;
+        buf_bytechar_index_find(b, bytepos, true, &mut indexed, &mut indexed_byte);
+        consider_known!(indexed_byte, indexed);
     }
 
     // We get here if we did not exactly hit one of the known places.
@@ -841,10 +872,10 @@ pub unsafe extern "C" fn buf_bytepos_to_charpos(b: *mut Lisp_Buffer, bytepos: is
         // But don't do it if BUF_MARKERS is nil;
         // that is a signal from Fset_buffer_multibyte.
         if record && buffer_ref.markers().is_some() {
-            build_marker(b, best_below, best_below_byte);
+            build_marker(b, best_above, best_above_byte);
         }
         if MARKER_DEBUG {
-            byte_char_debug_check(buffer_ref, best_below, best_below_byte);
+            byte_char_debug_check(buffer_ref, best_above, best_above_byte);
         }
 
         buffer_ref.is_cached = true;
@@ -33,6 +33,7 @@
 //! stretches of `std::str` functions.
 
 use std::fmt;
+use std::mem;
 use std::ptr;
 use std::slice;
 
@@ -311,20 +312,92 @@ fn string_overflow() -> ! {
     error!("Maximum string size exceeded")
 }
 
+// The scanners below look at text a machine word at a time.  Every
+// test they need is a per-byte bit test, so they do not care about
+// alignment or byte order, and the simple loops are left for the
+// compiler to vectorize where the target allows it.
+
+const WORD_BYTES: usize = mem::size_of::<usize>();
+
+/// A word with the high bit of every byte set.
+const HIGH_BITS: usize = usize::max_value() / 0xFF * 0x80;
+
+/// Read the word starting at byte IDX of SLICE, which must have at
+/// least WORD_BYTES bytes left.
+#[inline]
+fn load_word(slice: &[u8], idx: usize) -> usize {
+    debug_assert!(idx + WORD_BYTES <= slice.len());
+    unsafe { ptr::read_unaligned(slice.as_ptr().add(idx) as *const usize) }
+}
+
+/// Return the length of the longest prefix of SLICE that is pure ASCII.
+pub fn ascii_prefix_len(slice: &[u8]) -> usize {
+    let mut idx = 0;
+    while idx + WORD_BYTES <= slice.len() && load_word(slice, idx) & HIGH_BITS == 0 {
+        idx += WORD_BYTES;
+    }
+    idx + slice[idx..]
+        .iter()
+        .position(|&byte| byte & 0x80 != 0)
+        .unwrap_or(slice.len() - idx)
+}
+
+/// Return the number of bytes in SLICE that are not ASCII.
+fn count_non_ascii(slice: &[u8]) -> usize {
+    let mut idx = 0;
+    let mut count = 0;
+    while idx + WORD_BYTES <= slice.len() {
+        count += (load_word(slice, idx) & HIGH_BITS).count_ones() as usize;
+        idx += WORD_BYTES;
+    }
+    count
+        + slice[idx..]
+            .iter()
+            .filter(|&&byte| byte & 0x80 != 0)
+            .count()
+}
+
+/// Return the number of bytes in SLICE that start a character, i.e.
+/// are not of the form 10xxxxxx.  For valid multibyte text, this is
+/// the number of characters.
+fn count_char_heads(slice: &[u8]) -> usize {
+    let mut idx = 0;
+    let mut count = 0;
+    while idx + WORD_BYTES <= slice.len() {
+        let word = load_word(slice, idx);
+        // Shifting left by one moves bit 6 of every byte under its
+        // bit 7, so this keeps bit 7 exactly for continuation bytes.
+        let trailing = word & !(word << 1) & HIGH_BITS;
+        count += WORD_BYTES - trailing.count_ones() as usize;
+        idx += WORD_BYTES;
+    }
+    count
+        + slice[idx..]
+            .iter()
+            .filter(|&&byte| byte & 0xC0 != 0x80)
+            .count()
+}
+
+/// Return the number of leading bytes in the LEN bytes at PTR that are
+/// ASCII.  This is used by the decoders to skip plain text quickly.
+#[no_mangle]
+pub unsafe extern "C" fn ascii_prefix_length(ptr: *const c_uchar, len: ptrdiff_t) -> ptrdiff_t {
+    ascii_prefix_len(slice::from_raw_parts(ptr, len as usize)) as ptrdiff_t
+}
+
 /// Parse unibyte string at STR of LEN bytes, and return the number of
 /// bytes it may occupy when converted to multibyte string by
 /// `str_to_multibyte`.
 #[no_mangle]
 pub unsafe extern "C" fn count_size_as_multibyte(ptr: *const c_uchar, len: ptrdiff_t) -> ptrdiff_t {
     let slice = slice::from_raw_parts(ptr, len as usize);
-    slice.iter().fold(0, |total, &byte| {
-        let n = if is_ascii(Codepoint::from(byte)) {
-            1
-        } else {
-            2
-        };
-        total.checked_add(n).unwrap_or_else(|| string_overflow())
-    })
+    let total = (len as usize)
+        .checked_add(count_non_ascii(slice))
+        .unwrap_or_else(|| string_overflow());
+    if total > ptrdiff_t::max_value() as usize {
+        string_overflow();
+    }
+    total as ptrdiff_t
 }
 
 /// Same as the `BYTE8_TO_CHAR` macro.
@@ -592,15 +665,7 @@ pub unsafe extern "C" fn multibyte_chars_in_text(
     nbytes: ptrdiff_t,
 ) -> ptrdiff_t {
     let slice = slice::from_raw_parts(ptr, nbytes as usize);
-    let len = slice.len();
-    let mut idx = 0;
-    let mut chars = 0;
-    // TODO: make this an iterator?
-    while idx < len {
-        idx += multibyte_length(&slice[idx..], true).unwrap_or_else(|| panic!());
-        chars += 1;
-    }
-    chars as ptrdiff_t
+    count_char_heads(slice) as ptrdiff_t
 }
 
 /// Parse unibyte text at STR of LEN bytes as a multibyte text, count
@@ -617,9 +682,10 @@ pub unsafe extern "C" fn parse_str_as_multibyte(
 ) {
     let slice = slice::from_raw_parts(ptr, len as usize);
     let len = slice.len();
-    let mut chars = 0;
-    let mut bytes = 0;
-    let mut idx = 0;
+    // An ASCII prefix maps to itself, one byte per character.
+    let mut idx = ascii_prefix_len(slice);
+    let mut chars = idx as ptrdiff_t;
+    let mut bytes = idx as ptrdiff_t;
     // XXX: in the original, there is an "unchecked" version of multibyte_length
     // called while the remaining length is >= MAX_MULTIBYTE_LENGTH.
     while idx < len {
@@ -661,8 +727,8 @@ pub unsafe extern "C" fn str_as_multibyte(
     let slice = slice::from_raw_parts_mut(ptr, len as usize);
     // first, search ASCII-only prefix that we can skip processing
     let mut start = None;
-    let mut chars = 0;
-    let mut idx = 0;
+    let mut idx = ascii_prefix_len(&slice[..nbytes as usize]);
+    let mut chars = idx as ptrdiff_t;
     while idx < nbytes as usize {
         match multibyte_length(&slice[idx..], false) {
             None => {
@@ -6,7 +6,7 @@ use remacs_macros::lisp_fn;
 use crate::{
     lisp::{defsubr, LispObject},
     remacs_sys::{error, globals, Qnil},
-    remacs_sys::{make_log, memory_log, profiler_memory_running},
+    remacs_sys::{make_log, memory_log, profiler_memory_running, setup_alloc_logs},
 };
 
 /// Return non-nil if memory profiler is running.
@@ -18,6 +18,7 @@ pub fn profiler_memory_running_p() -> bool {
 /// Start/restart the memory profiler.
 /// The memory profiler will take samples of the call-stack whenever a new allocation takes
 /// place. Note that most small allocations only trigger the profiler occasionally.
+/// Allocations of Lisp objects are also logged per type, see `profiler-memory-type-log'.
 /// See also `profiler-log-size' and `profiler-max-stack-depth'.
 #[lisp_fn]
 pub fn profiler_memory_start() -> bool {
@@ -30,6 +31,7 @@ pub fn profiler_memory_start() -> bool {
         if memory_log.is_nil() {
             memory_log = make_log(globals.profiler_log_size, globals.profiler_max_stack_depth)
         }
+        setup_alloc_logs();
 
         profiler_memory_running = true;
     }
@@ -231,6 +231,23 @@ EMACS_INT consing_since_gc;
 
 EMACS_INT gc_relative_threshold;
 
+/* Threshold chosen by the adaptive policy of `gc-target-pause' and
+   `gc-target-overhead', or 0 if that policy is off.  maybe_gc calls
+   maybe_gc_adaptive once consing_since_gc exceeds gc_adaptive_trigger,
+   which is normally the same but moves up while GC is deferred.  */
+
+static EMACS_INT gc_adaptive_threshold;
+EMACS_INT gc_adaptive_trigger;
+
+/* Collection is deferred while input is pending only until this many
+   times gc_adaptive_threshold has been consed.  */
+
+enum { GC_DEFER_LIMIT = 2 };
+
+/* When the last garbage collection ended.  */
+
+static struct timespec gc_last_end;
+
 /* Minimum number of bytes of consing since GC before next GC,
    when memory is full.  */
 
@@ -240,6 +257,76 @@ EMACS_INT memory_full_cons_threshold;
 
 bool gc_in_progress;
 
+/* Phases of a garbage collection, timed separately.  The marking of
+   objects reachable from each set of roots is charged to the phase
+   that marks those roots.  Keep in sync with gc_phase_names.  */
+
+enum gc_phase
+  {
+    GC_PHASE_MARK_ROOTS,	/* Symbols, staticpro'd and pinned objects.  */
+    GC_PHASE_MARK_STACK,	/* Specpdl and conservative stack scan.  */
+    GC_PHASE_MARK_OTHER,	/* Font caches, undo lists, finalizers.  */
+    GC_PHASE_SWEEP_WEAK,
+    GC_PHASE_SWEEP_STRINGS,
+    GC_PHASE_COMPACT_STRINGS,
+    GC_PHASE_SWEEP_CONSES,
+    GC_PHASE_SWEEP_FLOATS,
+    GC_PHASE_SWEEP_INTERVALS,
+    GC_PHASE_SWEEP_SYMBOLS,
+    GC_PHASE_SWEEP_MISC,
+    GC_PHASE_SWEEP_BUFFERS,
+    GC_PHASE_SWEEP_VECTORS,
+    GC_PHASES
+  };
+
+static char const *const gc_phase_names[GC_PHASES] =
+  {
+    "mark-roots", "mark-stack", "mark-other", "sweep-weak",
+    "sweep-strings", "compact-strings", "sweep-conses", "sweep-floats",
+    "sweep-intervals", "sweep-symbols", "sweep-misc", "sweep-buffers",
+    "sweep-vectors"
+  };
+
+/* Timing of one garbage collection: the whole pause and each phase,
+   in seconds.  */
+
+struct gc_record
+{
+  double elapsed;
+  double phase[GC_PHASES];
+};
+
+/* Ring buffer of the most recent collections.  gc_history_next is
+   the slot the next collection goes to, and gc_history_count the
+   number of valid records.  */
+
+enum { GC_HISTORY_SIZE = 32 };
+static struct gc_record gc_history[GC_HISTORY_SIZE];
+static int gc_history_next, gc_history_count;
+
+/* Pause histograms, one per phase plus one for the whole pause.
+   Bucket 0 counts pauses under 1 ms, bucket I counts pauses of at
+   least 2^(I-1) ms and under 2^I ms, and the last bucket everything
+   longer.  */
+
+enum { GC_HISTOGRAM_BUCKETS = 14 };
+static EMACS_INT gc_histogram[GC_PHASES + 1][GC_HISTOGRAM_BUCKETS];
+
+/* The collection being timed, and the time its current phase began.  */
+
+static struct gc_record gc_current;
+static struct timespec gc_phase_start;
+
+/* Charge the time since the previous phase ended to PHASE.  */
+
+static void
+gc_phase_end (enum gc_phase phase)
+{
+  struct timespec now = current_timespec ();
+  gc_current.phase[phase] += timespectod (timespec_sub (now, gc_phase_start));
+  gc_phase_start = now;
+}
+
 /* Number of live and free conses etc.  */
 
 static EMACS_INT total_conses, total_markers, total_symbols, total_buffers;
@@ -456,6 +543,18 @@ static void *min_heap_address, *max_heap_address;
 static struct mem_node mem_z;
 #define MEM_NIL &mem_z
 
+/* A direct-mapped cache in front of the tree.  Slot
+   MEM_CACHE_INDEX (P) holds NULL or the node most recently found for
+   an address in the same BLOCK_ALIGN-sized chunk as P, so that most
+   lookups during conservative stack scanning are one load and two
+   compares instead of a tree walk.  mem_delete forgets the nodes it
+   frees or changes.  */
+
+enum { MEM_CACHE_SIZE = 4096 };
+static struct mem_node *mem_cache[MEM_CACHE_SIZE];
+#define MEM_CACHE_INDEX(p) \
+  (((uintptr_t) (p) / BLOCK_ALIGN) % MEM_CACHE_SIZE)
+
 static struct mem_node *mem_insert (void *, void *, enum mem_type);
 static void mem_insert_fixup (struct mem_node *);
 static void mem_rotate_left (struct mem_node *);
@@ -820,6 +919,14 @@ malloc_unblock_input (void)
       malloc_probe (size);			\
   } while (0)
 
+/* Charge SIZE bytes of a Lisp object of TYPE to the current backtrace.  */
+
+#define ALLOC_PROBE(type, size)			\
+  do {						\
+    if (profiler_memory_running)		\
+      alloc_probe (type, size);			\
+  } while (0)
+
 static void *lmalloc (size_t) ATTRIBUTE_MALLOC_SIZE ((1));
 static void *lrealloc (void *, size_t);
 
@@ -1936,6 +2043,7 @@ allocate_string (void)
   ++total_strings;
   ++strings_consed;
   consing_since_gc += sizeof *s;
+  ALLOC_PROBE (ALLOC_PROBE_STRING, sizeof *s);
 
 #ifdef GC_CHECK_STRING_BYTES
   if (!noninteractive)
@@ -2055,6 +2163,7 @@ allocate_string_data (struct Lisp_String *s,
     }
 
   consing_since_gc += needed;
+  ALLOC_PROBE (ALLOC_PROBE_STRING, needed);
 }
 
 
@@ -2152,7 +2261,9 @@ sweep_strings (void)
 
   string_blocks = live_blocks;
   free_large_strings ();
+  gc_phase_end (GC_PHASE_SWEEP_STRINGS);
   compact_small_strings ();
+  gc_phase_end (GC_PHASE_COMPACT_STRINGS);
 
   check_string_free_list ();
 }
@@ -2556,10 +2667,6 @@ make_formatted_string (char *buf, const char *format, ...)
   ((block)->gcmarkbits[(n) / BITS_PER_BITS_WORD]	\
    |= (bits_word) 1 << ((n) % BITS_PER_BITS_WORD))
 
-#define UNSETMARKBIT(block,n)				\
-  ((block)->gcmarkbits[(n) / BITS_PER_BITS_WORD]	\
-   &= ~((bits_word) 1 << ((n) % BITS_PER_BITS_WORD)))
-
 #define FLOAT_BLOCK(fptr) \
   ((struct float_block *) (((uintptr_t) (fptr)) & ~(BLOCK_ALIGN - 1)))
 
@@ -2580,9 +2687,6 @@ struct float_block
 #define FLOAT_MARK(fptr) \
   SETMARKBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
 
-#define FLOAT_UNMARK(fptr) \
-  UNSETMARKBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
-
 /* Current float_block.  */
 
 static struct float_block *float_block;
@@ -2634,6 +2738,7 @@ make_float (double float_value)
   consing_since_gc += sizeof (struct Lisp_Float);
   floats_consed++;
   total_free_floats--;
+  ALLOC_PROBE (ALLOC_PROBE_FLOAT, sizeof (struct Lisp_Float));
   return val;
 }
 
@@ -2674,9 +2779,6 @@ struct cons_block
 #define CONS_MARK(fptr) \
   SETMARKBIT (CONS_BLOCK (fptr), CONS_INDEX ((fptr)))
 
-#define CONS_UNMARK(fptr) \
-  UNSETMARKBIT (CONS_BLOCK (fptr), CONS_INDEX ((fptr)))
-
 /* Current cons_block.  */
 
 static struct cons_block *cons_block;
@@ -2740,6 +2842,7 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
   consing_since_gc += sizeof (struct Lisp_Cons);
   total_free_conses--;
   cons_cells_consed++;
+  ALLOC_PROBE (ALLOC_PROBE_CONS, sizeof (struct Lisp_Cons));
   return val;
 }
 
@@ -3303,6 +3406,7 @@ allocate_vector (EMACS_INT len)
   v = allocate_vectorlike (len);
   if (len)
     v->header.size = len;
+  ALLOC_PROBE (ALLOC_PROBE_VECTOR, header_size + len * word_size);
   return v;
 }
 
@@ -3324,6 +3428,9 @@ allocate_pseudovector (int memlen, int lisplen,
   /* Only the first LISPLEN slots will be traced normally by the GC.  */
   memclear (v->contents, zerolen * word_size);
   XSETPVECTYPESIZE (v, tag, lisplen, memlen - lisplen);
+  ALLOC_PROBE (tag == PVEC_HASH_TABLE ? ALLOC_PROBE_HASH_TABLE
+	       : ALLOC_PROBE_VECTOR,
+	       header_size + memlen * word_size);
   return v;
 }
 
@@ -3353,6 +3460,7 @@ allocate_record (EMACS_INT count)
   struct Lisp_Vector *p = allocate_vectorlike (count);
   p->header.size = count;
   XSETPVECTYPE (p, PVEC_RECORD);
+  ALLOC_PROBE (ALLOC_PROBE_VECTOR, header_size + count * word_size);
   return p;
 }
 
@@ -3631,6 +3739,7 @@ allocate_misc (enum Lisp_Misc_Type type)
   --total_free_markers;
   consing_since_gc += sizeof (union Lisp_Misc);
   misc_objects_consed++;
+  ALLOC_PROBE (ALLOC_PROBE_MISC, sizeof (union Lisp_Misc));
   XMISCANY (val)->type = type;
   XMISCANY (val)->gcmarkbit = 0;
   return val;
@@ -4086,10 +4195,16 @@ static struct mem_node *
 mem_find (void *start)
 {
   struct mem_node *p;
+  struct mem_node **slot;
 
   if (start < min_heap_address || start > max_heap_address)
     return MEM_NIL;
 
+  slot = &mem_cache[MEM_CACHE_INDEX (start)];
+  p = *slot;
+  if (p && p->start <= start && start < p->end)
+    return p;
+
   /* Make the search always successful to speed up the loop below.  */
   mem_z.start = start;
   mem_z.end = (char *) start + 1;
@@ -4097,9 +4212,27 @@ mem_find (void *start)
   p = mem_root;
   while (start < p->start || start >= p->end)
     p = start < p->start ? p->left : p->right;
+  if (p != MEM_NIL)
+    *slot = p;
   return p;
 }
 
+/* Remove from mem_cache any node that might have been cached for an
+   address in [START, END).  */
+
+static void
+mem_cache_forget (void *start, void *end)
+{
+  uintptr_t first = (uintptr_t) start / BLOCK_ALIGN;
+  uintptr_t last = ((uintptr_t) end - 1) / BLOCK_ALIGN;
+
+  if (last - first >= MEM_CACHE_SIZE)
+    memset (mem_cache, 0, sizeof mem_cache);
+  else
+    for (uintptr_t i = first; i <= last; i++)
+      mem_cache[i % MEM_CACHE_SIZE] = NULL;
+}
+
 
 /* Insert a new node into the tree for a block of memory with start
    address START, end address END, and type TYPE.  Value is a
@@ -4317,6 +4450,8 @@ mem_delete (struct mem_node *z)
   if (!z || z == MEM_NIL)
     return;
 
+  mem_cache_forget (z->start, z->end);
+
   if (z->left == MEM_NIL || z->right == MEM_NIL)
     y = z;
   else
@@ -4344,6 +4479,8 @@ mem_delete (struct mem_node *z)
 
   if (y != z)
     {
+      /* Z takes over Y's block, and Y is freed below.  */
+      mem_cache_forget (y->start, y->end);
       z->start = y->start;
       z->end = y->end;
       z->type = y->type;
@@ -5781,6 +5918,183 @@ mark_pinned_symbols (void)
     }
 }
 
+/* Return memory to the system after a collection that freed about
+   FREED bytes, if that is at least `gc-malloc-trim-threshold'.  Swept
+   blocks go back to malloc, which keeps them in its free lists; this
+   lets the resident size shrink to follow the live heap instead of
+   staying at its peak.  */
+
+static void
+maybe_malloc_trim (size_t freed)
+{
+#ifdef HAVE_MALLOC_TRIM
+  if (NATNUMP (Vgc_malloc_trim_threshold)
+      && XFASTINT (Vgc_malloc_trim_threshold) <= freed)
+    {
+      malloc_trim (0);
+      gc_malloc_trims++;
+    }
+#endif
+}
+
+/* Return the bucket of gc_histogram that a pause of SECONDS falls in.  */
+
+static int
+gc_histogram_bucket (double seconds)
+{
+  double ms = seconds * 1000;
+  int i;
+  for (i = 0; 1 <= ms && i < GC_HISTOGRAM_BUCKETS - 1; i++)
+    ms /= 2;
+  return i;
+}
+
+/* Store the collection just timed in gc_history and gc_histogram.  */
+
+static void
+gc_record_finish (void)
+{
+  for (int p = 0; p < GC_PHASES; p++)
+    gc_histogram[p][gc_histogram_bucket (gc_current.phase[p])]++;
+  gc_histogram[GC_PHASES][gc_histogram_bucket (gc_current.elapsed)]++;
+
+  gc_history[gc_history_next] = gc_current;
+  gc_history_next = (gc_history_next + 1) % GC_HISTORY_SIZE;
+  if (gc_history_count < GC_HISTORY_SIZE)
+    gc_history_count++;
+}
+
+/* Return R as a list (ELAPSED (PHASE . SECONDS)...).  */
+
+static Lisp_Object
+gc_record_to_lisp (struct gc_record const *r)
+{
+  Lisp_Object phases = Qnil;
+  for (int p = GC_PHASES - 1; 0 <= p; p--)
+    phases = Fcons (Fcons (intern_c_string (gc_phase_names[p]),
+			   make_float (r->phase[p])),
+		    phases);
+  return Fcons (make_float (r->elapsed), phases);
+}
+
+DEFUN ("gc-statistics", Fgc_statistics, Sgc_statistics, 0, 1, 0,
+       doc: /* Return timing statistics of recent garbage collections.
+The value is a list (RECENT HISTOGRAMS).
+
+RECENT lists the most recent collections, newest first.  Each element
+has the form (ELAPSED (PHASE . SECONDS)...), where ELAPSED is the
+length of the pause in seconds, and each PHASE is a symbol such as
+`mark-roots', `mark-stack' or `sweep-conses' naming a part of the
+collection that took SECONDS.  Marking objects reachable from a set of
+roots is charged to the phase that marks those roots.
+
+HISTOGRAMS is an alist (PHASE . COUNTS) with one entry per phase and a
+final entry for `total', the whole pause.  COUNTS is a vector: element
+0 counts collections where PHASE took less than 1 ms, element I counts
+those where it took at least 2^(I-1) ms and less than 2^I ms, and the
+last element counts all longer ones.
+
+If RESET is non-nil, discard the statistics after returning them.
+See also `gc-statistics-functions'.  */)
+  (Lisp_Object reset)
+{
+  Lisp_Object recent = Qnil, histograms = Qnil;
+
+  for (int i = 0; i < gc_history_count; i++)
+    {
+      int slot = (gc_history_next + GC_HISTORY_SIZE - gc_history_count + i)
+		 % GC_HISTORY_SIZE;
+      recent = Fcons (gc_record_to_lisp (&gc_history[slot]), recent);
+    }
+
+  for (int p = GC_PHASES; 0 <= p; p--)
+    {
+      Lisp_Object counts = make_uninit_vector (GC_HISTOGRAM_BUCKETS);
+      for (int i = 0; i < GC_HISTOGRAM_BUCKETS; i++)
+	ASET (counts, i, make_number (gc_histogram[p][i]));
+      histograms = Fcons (Fcons (p < GC_PHASES
+				 ? intern_c_string (gc_phase_names[p])
+				 : Qtotal,
+				 counts),
+			  histograms);
+    }
+
+  if (!NILP (reset))
+    {
+      gc_history_next = gc_history_count = 0;
+      memset (gc_histogram, 0, sizeof gc_histogram);
+    }
+
+  return list2 (recent, histograms);
+}
+
+/* Choose the threshold for the next collection from the timing of the
+   one just finished, according to `gc-target-pause' and
+   `gc-target-overhead'.  LIVE is the number of bytes live after it,
+   CONSED the number allocated since the previous collection, and
+   MUTATOR the seconds between the two, or 0 if unknown.  */
+
+static void
+gc_adapt_threshold (double live, double consed, double mutator)
+{
+  double pause = FLOATP (Vgc_target_pause) ? XFLOAT_DATA (Vgc_target_pause) : 0;
+  double overhead = (FLOATP (Vgc_target_overhead)
+		     ? XFLOAT_DATA (Vgc_target_overhead) : 0);
+  if (! (0 < overhead && overhead < 1))
+    overhead = 0;
+
+  if (! (0 < pause || 0 < overhead))
+    {
+      gc_adaptive_threshold = gc_adaptive_trigger = 0;
+      return;
+    }
+
+  /* Model a pause as marking what is live plus sweeping that and what
+     was consed since the previous collection, at the rates just seen.
+     FIXED is the part of it that does not depend on the threshold.  */
+  double mark = 0, sweep = 0;
+  for (int p = 0; p < GC_PHASES; p++)
+    if (p <= GC_PHASE_MARK_OTHER)
+      mark += gc_current.phase[p];
+    else
+      sweep += gc_current.phase[p];
+  double mark_rate = 0 < live ? mark / live : 0;
+  double sweep_rate = 0 < live + consed ? sweep / (live + consed) : 0;
+  double fixed = (mark_rate + sweep_rate) * live;
+  double threshold = -1;
+
+  /* The largest threshold whose pause fits in the target.  */
+  if (0 < pause && 0 < sweep_rate && fixed < pause)
+    threshold = (pause - fixed) / sweep_rate;
+
+  /* The smallest threshold that keeps GC within OVERHEAD of the run
+     time at the allocation rate seen since the previous collection.
+     When it exceeds the pause bound, the pause target wins.  */
+  if (0 < overhead && 0 < mutator && 0 < consed)
+    {
+      double alloc_rate = consed / mutator;
+      double margin = overhead - sweep_rate * alloc_rate * (1 - overhead);
+      if (0 < margin)
+	{
+	  double t = fixed * alloc_rate * (1 - overhead) / margin;
+	  threshold = threshold < 0 ? t : min (threshold, t);
+	}
+    }
+
+  /* If neither target can be met or measured, fall back on the
+     user's thresholds.  */
+  if (threshold < 0)
+    threshold = max (gc_cons_threshold, gc_relative_threshold);
+
+  /* Smooth the estimate so that one odd collection does not swing it.  */
+  if (0 < gc_adaptive_threshold)
+    threshold = (threshold + gc_adaptive_threshold) / 2;
+
+  threshold = max (threshold, GC_DEFAULT_THRESHOLD / 10);
+  threshold = min (threshold, MOST_POSITIVE_FIXNUM / GC_DEFER_LIMIT);
+  gc_adaptive_threshold = gc_adaptive_trigger = threshold;
+}
+
 /* Subroutine of Fgarbage_collect that does most of the work.  It is a
    separate function so that we could limit mark_stack in searching
    the stack frames below this function, thus avoiding the rare cases
@@ -5799,6 +6113,9 @@ garbage_collect_1 (void *end)
   struct timespec start;
   Lisp_Object retval = Qnil;
   size_t tot_before = 0;
+  size_t heap_before = 0;
+  bool trim_p = NATNUMP (Vgc_malloc_trim_threshold);
+  EMACS_INT consed = max (consing_since_gc, 0);
 
   /* Can't GC if pure storage overflowed because we can't determine
      if something is a pure object or not.  */
@@ -5818,6 +6135,11 @@ garbage_collect_1 (void *end)
   if (profiler_memory_running)
     tot_before = total_bytes_of_live_objects ();
 
+  /* What was live after the last collection, plus what was consed
+     since; used to estimate how much this collection frees.  */
+  if (trim_p)
+    heap_before = total_bytes_of_live_objects () + consed;
+
   start = current_timespec ();
 
   /* In case user calls debug_print during GC,
@@ -5873,6 +6195,9 @@ garbage_collect_1 (void *end)
 
   gc_in_progress = 1;
 
+  memset (&gc_current, 0, sizeof gc_current);
+  gc_phase_start = current_timespec ();
+
   /* Mark all the special slots that serve as the roots of accessibility.  */
 
   mark_buffer (&buffer_defaults);
@@ -5888,7 +6213,10 @@ garbage_collect_1 (void *end)
   mark_pinned_symbols ();
   mark_terminals ();
   mark_kboards ();
+  mark_regexp_cache ();
+  gc_phase_end (GC_PHASE_MARK_ROOTS);
   mark_threads ();
+  gc_phase_end (GC_PHASE_MARK_STACK);
 
 #ifdef USE_GTK
   xg_mark_data ();
@@ -5926,9 +6254,17 @@ garbage_collect_1 (void *end)
 
   queue_doomed_finalizers (&doomed_finalizers, &finalizers);
   mark_finalizer_list (&doomed_finalizers);
+  gc_phase_end (GC_PHASE_MARK_OTHER);
 
   gc_sweep ();
 
+  if (trim_p)
+    {
+      size_t heap_after = total_bytes_of_live_objects ();
+      if (heap_before > heap_after)
+	maybe_malloc_trim (heap_before - heap_after);
+    }
+
   /* Clear the mark bits that we set in certain root slots.  */
   VECTOR_UNMARK (&buffer_defaults);
   VECTOR_UNMARK (&buffer_local_symbols);
@@ -5939,6 +6275,12 @@ garbage_collect_1 (void *end)
 
   unblock_input ();
 
+  double mutator = (timespec_sign (gc_last_end) > 0
+		    ? timespectod (timespec_sub (start, gc_last_end)) : 0);
+  gc_last_end = current_timespec ();
+  gc_current.elapsed = timespectod (timespec_sub (gc_last_end, start));
+  gc_record_finish ();
+
   consing_since_gc = 0;
   if (gc_cons_threshold < GC_DEFAULT_THRESHOLD / 10)
     gc_cons_threshold = GC_DEFAULT_THRESHOLD / 10;
@@ -5958,6 +6300,8 @@ garbage_collect_1 (void *end)
 	}
     }
 
+  gc_adapt_threshold (total_bytes_of_live_objects (), consed, mutator);
+
   if (garbage_collection_messages && NILP (Vmemory_full))
     {
       if (message_p || minibuf_level > 0)
@@ -6016,6 +6360,14 @@ garbage_collect_1 (void *end)
       unbind_to (gc_count, Qnil);
     }
 
+  if (!NILP (Vgc_statistics_functions))
+    {
+      ptrdiff_t gc_count = inhibit_garbage_collection ();
+      safe_call2 (Qrun_hook_with_args, Qgc_statistics_functions,
+		  gc_record_to_lisp (&gc_current));
+      unbind_to (gc_count, Qnil);
+    }
+
   /* Accumulate statistics.  */
   if (FLOATP (Vgc_elapsed))
     {
@@ -6062,6 +6414,59 @@ See Info node `(elisp)Garbage Collection'.  */
   return garbage_collect_1 (end);
 }
 
+/* Called by read_char when Emacs is about to wait for input and none
+   is pending.  A collection is bound to happen soon anyway once
+   `gc-idle-cons-fraction' of the threshold maybe_gc uses has been
+   consed, so do it now, while the user is not typing, instead of in
+   the middle of the next command.  */
+
+void
+maybe_gc_when_idle (void)
+{
+  if (FLOATP (Vgc_idle_cons_fraction) && NILP (Vmemory_full))
+    {
+      double fraction = XFLOAT_DATA (Vgc_idle_cons_fraction);
+
+      if (0 < fraction && fraction < 1)
+	{
+	  double threshold = (0 < gc_adaptive_threshold
+			      ? gc_adaptive_threshold
+			      : max (gc_cons_threshold, gc_relative_threshold));
+
+	  if (consing_since_gc > threshold * fraction)
+	    {
+	      Fgarbage_collect ();
+	      return;
+	    }
+	}
+    }
+
+  maybe_gc ();
+}
+
+/* Collect garbage on behalf of maybe_gc once the adaptive policy's
+   trigger is reached.  While input is pending, put it off so as not to
+   delay the response, but only until GC_DEFER_LIMIT times the
+   threshold has been consed.  */
+
+void
+maybe_gc_adaptive (void)
+{
+  /* Binding gc-cons-threshold to the maximum still inhibits GC, as
+     inhibit_garbage_collection relies on.  */
+  if (gc_cons_threshold == MOST_POSITIVE_FIXNUM)
+    return;
+
+  if (consing_since_gc < gc_adaptive_threshold * GC_DEFER_LIMIT
+      && detect_input_pending ())
+    {
+      gc_adaptive_trigger = consing_since_gc + gc_adaptive_threshold / 8;
+      return;
+    }
+
+  Fgarbage_collect ();
+}
+
 /* Mark Lisp objects in glyph matrix MATRIX.  Currently the
    only interesting objects referenced from glyphs are strings.  */
 
@@ -6096,17 +6501,147 @@ mark_glyph_matrix (struct glyph_matrix *matrix)
 Lisp_Object last_marked[LAST_MARKED_SIZE] EXTERNALLY_VISIBLE;
 static int last_marked_index;
 
-/* For debugging--call abort when we cdr down this many
-   links of a list, in mark_object.  In debugging,
-   the call to abort will hit a breakpoint.
-   Normally this is zero and the check never goes off.  */
-ptrdiff_t mark_object_loop_halt EXTERNALLY_VISIBLE;
+/* An entry on the mark stack: the single object U.VALUE if N is
+   zero, otherwise the N objects starting at U.VALUES.  */
+
+struct mark_entry
+{
+  ptrdiff_t n;
+  union
+  {
+    Lisp_Object value;
+    Lisp_Object *values;
+  } u;
+};
+
+/* The stack of objects that still need to be marked.  mark_object
+   works off this explicitly instead of recursing, so that marking
+   deeply nested structures does not overflow the C stack.  */
+
+struct mark_stack
+{
+  struct mark_entry *stack;	/* Base of the stack.  */
+  ptrdiff_t size;		/* Allocated size, in entries.  */
+  ptrdiff_t sp;			/* Number of entries in use.  */
+  bool fixed;			/* True if STACK is on the C stack.  */
+};
+
+static struct mark_stack mark_stk;
+
+/* Fetch the memory at P into the cache ahead of its use.  Marking
+   mostly misses the cache, so start loading an object's header as
+   soon as we know we will look at it.  */
+
+#if GNUC_PREREQ (3, 1, 0)
+# define MARK_PREFETCH(p) __builtin_prefetch (p)
+#else
+# define MARK_PREFETCH(p) ((void) 0)
+#endif
+
+/* Try to make room for more entries on the mark stack.  Use plain
+   realloc, not xpalloc: memory_full would signal in the middle of GC,
+   with mark bits half set.  Return false on failure.  */
+
+static bool
+mark_stack_grow (void)
+{
+  ptrdiff_t size, nbytes;
+
+  if (mark_stk.fixed
+      || INT_MULTIPLY_WRAPV (max (mark_stk.size, 512), 2, &size)
+      || INT_MULTIPLY_WRAPV (size, sizeof *mark_stk.stack, &nbytes)
+      || SIZE_MAX < nbytes)
+    return false;
+
+  struct mark_entry *stack = realloc (mark_stk.stack, nbytes);
+  if (!stack)
+    return false;
+  mark_stk.stack = stack;
+  mark_stk.size = size;
+  return true;
+}
+
+static void process_mark_stack (ptrdiff_t);
+
+/* Mark the objects of ENTRY now, because the mark stack cannot grow.
+   Use a fresh stack in this frame, so that running out of memory
+   costs only a little C stack per MARK_STACK_LOCAL entries.  */
+
+enum { MARK_STACK_LOCAL = 256 };
+
+NO_INLINE static void
+mark_stack_overflow (struct mark_entry entry)
+{
+  struct mark_entry local[MARK_STACK_LOCAL];
+  struct mark_stack saved = mark_stk;
+
+  mark_stk.stack = local;
+  mark_stk.size = ARRAYELTS (local);
+  mark_stk.sp = 0;
+  mark_stk.fixed = true;
+  local[mark_stk.sp++] = entry;
+  process_mark_stack (0);
+  mark_stk = saved;
+}
 
 static void
-mark_vectorlike (struct Lisp_Vector *ptr)
+mark_stack_push (struct mark_entry entry)
+{
+  if (mark_stk.sp == mark_stk.size && !mark_stack_grow ())
+    mark_stack_overflow (entry);
+  else
+    mark_stk.stack[mark_stk.sp++] = entry;
+}
+
+/* Push OBJ on the mark stack.  */
+
+static void
+mark_stack_push_value (Lisp_Object obj)
+{
+  if (INTEGERP (obj))
+    return;
+  MARK_PREFETCH (XPNTR (obj));
+  mark_stack_push ((struct mark_entry) { .n = 0, .u.value = obj });
+}
+
+/* Push the N objects starting at VALUES on the mark stack.  */
+
+static void
+mark_stack_push_values (Lisp_Object *values, ptrdiff_t n)
+{
+  if (n > 0)
+    mark_stack_push ((struct mark_entry) { .n = n, .u.values = values });
+}
+
+/* Pop the next object to mark from the mark stack, which must not be
+   empty.  */
+
+static Lisp_Object
+mark_stack_pop (void)
+{
+  struct mark_entry *e = &mark_stk.stack[mark_stk.sp - 1];
+
+  if (e->n == 0)
+    {
+      mark_stk.sp--;
+      return e->u.value;
+    }
+
+  Lisp_Object obj = *e->u.values++;
+  if (--e->n == 0)
+    mark_stk.sp--;
+  else if (! INTEGERP (*e->u.values))
+    MARK_PREFETCH (XPNTR (*e->u.values));
+  return obj;
+}
+
+/* Mark the vectorlike PTR itself and push the Lisp_Objects it
+   contains on the mark stack, without marking them yet.  */
+
+static void
+push_vectorlike (struct Lisp_Vector *ptr)
 {
   ptrdiff_t size = ptr->header.size;
-  ptrdiff_t i;
 
   eassert (!VECTOR_MARKED_P (ptr));
   VECTOR_MARK (ptr);		/* Else mark it.  */
@@ -6117,8 +6652,16 @@ mark_vectorlike (struct Lisp_Vector *ptr)
      the number of Lisp_Object fields that we should trace.
      The distinction is used e.g. by Lisp_Process which places extra
      non-Lisp_Object fields at the end of the structure...  */
-  for (i = 0; i < size; i++) /* ...and then mark its elements.  */
-    mark_object (ptr->contents[i]);
+  mark_stack_push_values (ptr->contents, size);
+}
+
+static void
+mark_vectorlike (struct Lisp_Vector *ptr)
+{
+  ptrdiff_t base_sp = mark_stk.sp;
+
+  push_vectorlike (ptr);
+  process_mark_stack (base_sp);
 }
 
 /* Like mark_vectorlike but optimized for char-tables (and
@@ -6150,19 +6693,6 @@ mark_char_table (struct Lisp_Vector *ptr, enum pvec_type pvectype)
     }
 }
 
-NO_INLINE /* To reduce stack depth in mark_object.  */
-static Lisp_Object
-mark_compiled (struct Lisp_Vector *ptr)
-{
-  int i, size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
-
-  VECTOR_MARK (ptr);
-  for (i = 0; i < size; i++)
-    if (i != COMPILED_CONSTANTS)
-      mark_object (ptr->contents[i]);
-  return size > COMPILED_CONSTANTS ? ptr->contents[COMPILED_CONSTANTS] : Qnil;
-}
-
 /* Mark the chain of overlays starting at PTR.  */
 
 static void
@@ -6296,30 +6826,34 @@ mark_discard_killed_buffers (Lisp_Object list)
   return list;
 }
 
-/* Determine type of generic Lisp_Object and mark it accordingly.
+/* Mark the objects on the mark stack above BASE_SP, and everything
+   reachable from them, until the stack is back down to BASE_SP.
 
-   This function implements a straightforward depth-first marking
-   algorithm and so the recursion depth may be very high (a few
-   tens of thousands is not uncommon).  To minimize stack usage,
-   a few cold paths are moved out to NO_INLINE functions above.
-   In general, inlining them doesn't help you to gain more speed.  */
+   This is a straightforward depth-first marking algorithm, except
+   that instead of recursing into the components of an object it
+   pushes them on mark_stk, so the depth of the structures it can mark
+   is limited only by memory.  A few cold paths are moved out to
+   NO_INLINE functions above; they call mark_object, which runs a
+   nested loop on the same stack.  */
 
-void
-mark_object (Lisp_Object arg)
+static void
+process_mark_stack (ptrdiff_t base_sp)
 {
-  register Lisp_Object obj;
+  Lisp_Object obj;
   void *po;
 #if GC_CHECK_MARKED_OBJECTS
   struct mem_node *m;
 #endif
-  ptrdiff_t cdr_count = 0;
 
-  obj = arg;
+ next:
+  if (mark_stk.sp <= base_sp)
+    return;
+  obj = mark_stack_pop ();
  loop:
 
   po = XPNTR (obj);
   if (PURE_P (po))
-    return;
+    goto next;
 
   last_marked[last_marked_index++] = obj;
   if (last_marked_index == LAST_MARKED_SIZE)
@@ -6427,21 +6961,11 @@ mark_object (Lisp_Object arg)
 	    mark_buffer ((struct buffer *) ptr);
 	    break;
 
-	  case PVEC_COMPILED:
-	    /* Although we could treat this just like a vector, mark_compiled
-	       returns the COMPILED_CONSTANTS element, which is marked at the
-	       next iteration of goto-loop here.  This is done to avoid a few
-	       recursive calls to mark_object.  */
-	    obj = mark_compiled (ptr);
-	    if (!NILP (obj))
-	      goto loop;
-	    break;
-
 	  case PVEC_FRAME:
 	    {
 	      struct frame *f = (struct frame *) ptr;
 
-	      mark_vectorlike (ptr);
+	      push_vectorlike (ptr);
 	      mark_face_cache (f->face_cache);
 #ifdef HAVE_WINDOW_SYSTEM
 	      if (FRAME_WINDOW_P (f) && FRAME_X_OUTPUT (f))
@@ -6449,7 +6973,7 @@ mark_object (Lisp_Object arg)
 		  struct font *font = FRAME_FONT (f);
 
 		  if (font && !VECTOR_MARKED_P (font))
-		    mark_vectorlike ((struct Lisp_Vector *) font);
+		    push_vectorlike ((struct Lisp_Vector *) font);
 		}
 #endif
 	    }
@@ -6459,7 +6983,7 @@ mark_object (Lisp_Object arg)
 	    {
 	      struct window *w = (struct window *) ptr;
 
-	      mark_vectorlike (ptr);
+	      push_vectorlike (ptr);
 
 	      /* Mark glyph matrices, if any.  Marking window
 		 matrices is sufficient because frame matrices
@@ -6485,14 +7009,14 @@ mark_object (Lisp_Object arg)
 	    {
 	      struct Lisp_Hash_Table *h = (struct Lisp_Hash_Table *) ptr;
 
-	      mark_vectorlike (ptr);
-	      mark_object (h->test.name);
-	      mark_object (h->test.user_hash_function);
-	      mark_object (h->test.user_cmp_function);
+	      push_vectorlike (ptr);
+	      mark_stack_push_value (h->test.name);
+	      mark_stack_push_value (h->test.user_hash_function);
+	      mark_stack_push_value (h->test.user_cmp_function);
 	      /* If hash table is not weak, mark all keys and values.
 		 For weak tables, mark only the vector.  */
 	      if (NILP (h->weak))
-		mark_object (h->key_and_value);
+		mark_stack_push_value (h->key_and_value);
 	      else
 		VECTOR_MARK (XVECTOR (h->key_and_value));
 	    }
@@ -6515,7 +7039,7 @@ mark_object (Lisp_Object arg)
 	    emacs_abort ();
 
 	  default:
-	    mark_vectorlike (ptr);
+	    push_vectorlike (ptr);
 	  }
       }
       break;
@@ -6530,16 +7054,16 @@ mark_object (Lisp_Object arg)
 	ptr->u.s.gcmarkbit = 1;
 	/* Attempt to catch bogus objects.  */
 	eassert (valid_lisp_object_p (ptr->u.s.function));
-	mark_object (ptr->u.s.function);
-	mark_object (ptr->u.s.plist);
+	mark_stack_push_value (ptr->u.s.function);
+	mark_stack_push_value (ptr->u.s.plist);
 	switch (ptr->u.s.redirect)
 	  {
-	  case SYMBOL_PLAINVAL: mark_object (SYMBOL_VAL (ptr)); break;
+	  case SYMBOL_PLAINVAL: mark_stack_push_value (SYMBOL_VAL (ptr)); break;
 	  case SYMBOL_VARALIAS:
 	    {
 	      Lisp_Object tem;
 	      XSETSYMBOL (tem, SYMBOL_ALIAS (ptr));
-	      mark_object (tem);
+	      mark_stack_push_value (tem);
 	      break;
 	    }
 	  case SYMBOL_LOCALIZED:
@@ -6589,7 +7113,7 @@ mark_object (Lisp_Object arg)
 
         case Lisp_Misc_Finalizer:
           XMISCANY (obj)->gcmarkbit = true;
-          mark_object (XFINALIZER (obj)->function);
+          mark_stack_push_value (XFINALIZER (obj)->function);
           break;
 
 #ifdef HAVE_MODULES
@@ -6610,18 +7134,11 @@ mark_object (Lisp_Object arg)
 	  break;
 	CHECK_ALLOCATED_AND_LIVE (live_cons_p);
 	CONS_MARK (ptr);
-	/* If the cdr is nil, avoid recursion for the car.  */
-	if (EQ (ptr->u.s.u.cdr, Qnil))
-	  {
-	    obj = ptr->u.s.car;
-	    cdr_count = 0;
-	    goto loop;
-	  }
-	mark_object (ptr->u.s.car);
-	obj = ptr->u.s.u.cdr;
-	cdr_count++;
-	if (cdr_count == mark_object_loop_halt)
-	  emacs_abort ();
+	/* Leave the cdr for later and go on with the car right away.
+	   Walking down a list then needs just one stack entry at a
+	   time, however long the list is.  */
+	mark_stack_push_value (ptr->u.s.u.cdr);
+	obj = ptr->u.s.car;
 	goto loop;
       }
 
@@ -6637,10 +7154,23 @@ mark_object (Lisp_Object arg)
       emacs_abort ();
     }
 
+  goto next;
+
 #undef CHECK_LIVE
 #undef CHECK_ALLOCATED
 #undef CHECK_ALLOCATED_AND_LIVE
 }
+
+/* Mark ARG and, recursively, all the objects it references.  */
+
+void
+mark_object (Lisp_Object arg)
+{
+  ptrdiff_t base_sp = mark_stk.sp;
+
+  mark_stack_push_value (arg);
+  process_mark_stack (base_sp);
+}
 /* Mark the Lisp pointers in the terminal objects.
    Called by Fgarbage_collect.  */
 
@@ -6712,6 +7242,312 @@ survives_gc_p (Lisp_Object obj)
 
 
 
+/* The result of sweeping one cons block.  */
+
+struct cons_sweep_block
+{
+  /* The block, and the number of cons cells in use in it.  */
+  struct cons_block *block;
+  int lim;
+
+  /* The unmarked cells of BLOCK, chained most recently freed first,
+     and the last cell of that chain.  */
+  struct Lisp_Cons *free, *tail;
+
+  /* Number of cells in the chain.  */
+  int nfree;
+};
+
+/* Sweep B->block, clearing the mark bits of its live cells and
+   chaining its dead ones.  Touch nothing outside the block, so that
+   sweep_conses can run this for different blocks in parallel.  */
+
+static void
+sweep_cons_block (struct cons_sweep_block *b)
+{
+  struct cons_block *cblk = b->block;
+  struct Lisp_Cons *free = NULL, *tail = NULL;
+  int lim = b->lim;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+  int i, this_free = 0;
+
+  /* Scan the mark bits an int at a time.  */
+  for (i = 0; i < ilim; i++)
+    {
+      int start, pos, stop;
+
+      if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
+        {
+          /* Fast path - all cons cells for this int are marked.  */
+          cblk->gcmarkbits[i] = 0;
+          continue;
+        }
+
+      start = i * BITS_PER_BITS_WORD;
+      stop = lim - start;
+      if (stop > BITS_PER_BITS_WORD)
+        stop = BITS_PER_BITS_WORD;
+      stop += start;
+
+      /* Some cons cells for this int are not marked.  Find which
+         ones, and free them.  If none is marked, which is the common
+         case for short-lived conses, skip testing each mark bit.  */
+      bool all_free = cblk->gcmarkbits[i] == 0;
+      for (pos = start; pos < stop; pos++)
+        {
+          struct Lisp_Cons *acons = ptr_bounds_copy (&cblk->conses[pos], cblk);
+          if (all_free || !CONS_MARKED_P (acons))
+            {
+              this_free++;
+              cblk->conses[pos].u.s.u.chain = free;
+              free = &cblk->conses[pos];
+              free->u.s.car = Vdead;
+              if (!tail)
+                tail = free;
+            }
+        }
+      cblk->gcmarkbits[i] = 0;
+    }
+
+  b->free = free;
+  b->tail = tail;
+  b->nfree = this_free;
+}
+
+/* The result of sweeping one float block, as for cons blocks.  */
+
+struct float_sweep_block
+{
+  struct float_block *block;
+  int lim;
+  struct Lisp_Float *free, *tail;
+  int nfree;
+};
+
+/* Sweep B->block like sweep_cons_block.  */
+
+static void
+sweep_float_block (struct float_sweep_block *b)
+{
+  struct float_block *fblk = b->block;
+  struct Lisp_Float *free = NULL, *tail = NULL;
+  int lim = b->lim;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+  int i, this_free = 0;
+
+  /* Scan the mark bits an int at a time, as sweep_cons_block does.  */
+  for (i = 0; i < ilim; i++)
+    {
+      int start, pos, stop;
+      bits_word bits = fblk->gcmarkbits[i];
+
+      if (bits == BITS_WORD_MAX)
+	{
+	  /* Fast path - all floats for this int are marked.  */
+	  fblk->gcmarkbits[i] = 0;
+	  continue;
+	}
+
+      start = i * BITS_PER_BITS_WORD;
+      stop = lim - start;
+      if (stop > BITS_PER_BITS_WORD)
+	stop = BITS_PER_BITS_WORD;
+      stop += start;
+
+      for (pos = start; pos < stop; pos++)
+	if (! ((bits >> (pos - start)) & 1))
+	  {
+	    this_free++;
+	    fblk->floats[pos].u.chain = free;
+	    free = &fblk->floats[pos];
+	    if (!tail)
+	      tail = free;
+	  }
+      fblk->gcmarkbits[i] = 0;
+    }
+
+  b->free = free;
+  b->tail = tail;
+  b->nfree = this_free;
+}
+
+#ifdef HAVE_PTHREAD
+
+/* Don't bother with helper threads unless each of them gets at least
+   this many blocks to sweep.  */
+
+enum { SWEEP_MIN_BLOCKS = 64 };
+
+/* Scratch arrays of blocks for a parallel sweep, and their sizes.
+   They are grown with plain realloc, because nothing may signal in
+   the middle of GC; if that fails, the blocks are swept by the
+   current thread alone.  */
+
+static struct cons_sweep_block *cons_sweep_blocks;
+static ptrdiff_t cons_sweep_blocks_size;
+static struct float_sweep_block *float_sweep_blocks;
+static ptrdiff_t float_sweep_blocks_size;
+
+/* A contiguous part of one of the scratch arrays swept by one
+   thread.  SWEEP sweeps the elements from START to END.  */
+
+struct sweep_job
+{
+  void (*sweep) (ptrdiff_t, ptrdiff_t);
+  ptrdiff_t start, end;
+  pthread_t thread;
+  bool started;
+};
+
+static void
+sweep_cons_range (ptrdiff_t start, ptrdiff_t end)
+{
+  for (ptrdiff_t i = start; i < end; i++)
+    sweep_cons_block (&cons_sweep_blocks[i]);
+}
+
+static void
+sweep_float_range (ptrdiff_t start, ptrdiff_t end)
+{
+  for (ptrdiff_t i = start; i < end; i++)
+    sweep_float_block (&float_sweep_blocks[i]);
+}
+
+static void *
+sweep_worker (void *arg)
+{
+  struct sweep_job *job = arg;
+
+  job->sweep (job->start, job->end);
+  return NULL;
+}
+
+/* Return the number of threads, the current one included, that
+   should sweep NBLOCKS blocks.  */
+
+static int
+sweep_nthreads (ptrdiff_t nblocks)
+{
+  return max (1, min (min (gc_sweep_threads, 64),
+		      nblocks / SWEEP_MIN_BLOCKS));
+}
+
+/* Call SWEEP on NBLOCKS blocks split among NTHREADS threads,
+   including the current one.  */
+
+static void
+sweep_blocks_parallel (void (*sweep) (ptrdiff_t, ptrdiff_t),
+		       ptrdiff_t nblocks, int nthreads)
+{
+  struct sweep_job jobs[64];
+  sigset_t blocked, oldset;
+  int i;
+
+  nthreads = min (nthreads, (int) ARRAYELTS (jobs));
+  for (i = 0; i < nthreads; i++)
+    {
+      jobs[i].sweep = sweep;
+      jobs[i].start = nblocks * i / nthreads;
+      jobs[i].end = nblocks * (i + 1) / nthreads;
+      jobs[i].started = false;
+    }
+
+  /* Signal handlers must run in the main thread, so keep the helpers
+     from ever receiving a signal.  */
+  sigfillset (&blocked);
+  pthread_sigmask (SIG_BLOCK, &blocked, &oldset);
+  for (i = 1; i < nthreads; i++)
+    jobs[i].started = pthread_create (&jobs[i].thread, NULL,
+				      sweep_worker, &jobs[i]) == 0;
+  pthread_sigmask (SIG_SETMASK, &oldset, 0);
+
+  /* Sweep our own share, and that of any helper that failed to
+     start.  */
+  for (i = 0; i < nthreads; i++)
+    if (i == 0 || !jobs[i].started)
+      sweep_worker (&jobs[i]);
+
+  for (i = 1; i < nthreads; i++)
+    if (jobs[i].started)
+      pthread_join (jobs[i].thread, NULL);
+}
+
+/* Sweep all cons blocks with several threads, if gc-sweep-threads and
+   the heap size call for that, leaving the results in
+   cons_sweep_blocks.  Return false if the caller must sweep them
+   itself.  */
+
+static bool
+sweep_cons_blocks_parallel (void)
+{
+  struct cons_block *cblk;
+  ptrdiff_t i, nblocks = 0;
+
+  if (gc_sweep_threads <= 1)
+    return false;
+  for (cblk = cons_block; cblk; cblk = cblk->next)
+    nblocks++;
+  int nthreads = sweep_nthreads (nblocks);
+  if (nthreads <= 1)
+    return false;
+
+  if (cons_sweep_blocks_size < nblocks)
+    {
+      struct cons_sweep_block *p
+	= realloc (cons_sweep_blocks, nblocks * sizeof *p);
+      if (!p)
+	return false;
+      cons_sweep_blocks = p;
+      cons_sweep_blocks_size = nblocks;
+    }
+
+  for (cblk = cons_block, i = 0; cblk; cblk = cblk->next, i++)
+    {
+      cons_sweep_blocks[i].block = cblk;
+      cons_sweep_blocks[i].lim = i == 0 ? cons_block_index : CONS_BLOCK_SIZE;
+    }
+  sweep_blocks_parallel (sweep_cons_range, nblocks, nthreads);
+  return true;
+}
+
+/* Likewise for float blocks and float_sweep_blocks.  */
+
+static bool
+sweep_float_blocks_parallel (void)
+{
+  struct float_block *fblk;
+  ptrdiff_t i, nblocks = 0;
+
+  if (gc_sweep_threads <= 1)
+    return false;
+  for (fblk = float_block; fblk; fblk = fblk->next)
+    nblocks++;
+  int nthreads = sweep_nthreads (nblocks);
+  if (nthreads <= 1)
+    return false;
+
+  if (float_sweep_blocks_size < nblocks)
+    {
+      struct float_sweep_block *p
+	= realloc (float_sweep_blocks, nblocks * sizeof *p);
+      if (!p)
+	return false;
+      float_sweep_blocks = p;
+      float_sweep_blocks_size = nblocks;
+    }
+
+  for (fblk = float_block, i = 0; fblk; fblk = fblk->next, i++)
+    {
+      float_sweep_blocks[i].block = fblk;
+      float_sweep_blocks[i].lim = (i == 0 ? float_block_index
+				   : FLOAT_BLOCK_SIZE);
+    }
+  sweep_blocks_parallel (sweep_float_range, nblocks, nthreads);
+  return true;
+}
+
+#endif /* HAVE_PTHREAD */
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_conses (void)
@@ -6720,70 +7556,50 @@ sweep_conses (void)
   struct cons_block **cprev = &cons_block;
   int lim = cons_block_index;
   EMACS_INT num_free = 0, num_used = 0;
+  ptrdiff_t i;
 
   cons_free_list = 0;
 
-  for (cblk = cons_block; cblk; cblk = *cprev)
-    {
-      int i = 0;
-      int this_free = 0;
-      int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
-
-      /* Scan the mark bits an int at a time.  */
-      for (i = 0; i < ilim; i++)
-        {
-          if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
-            {
-              /* Fast path - all cons cells for this int are marked.  */
-              cblk->gcmarkbits[i] = 0;
-              num_used += BITS_PER_BITS_WORD;
-            }
-          else
-            {
-              /* Some cons cells for this int are not marked.
-                 Find which ones, and free them.  */
-              int start, pos, stop;
+#ifdef HAVE_PTHREAD
+  /* The blocks are independent of each other, so with several
+     threads, sweep them all first and only then merge the results
+     below, in the same order a single thread would.  */
+  bool swept = sweep_cons_blocks_parallel ();
+#endif
 
-              start = i * BITS_PER_BITS_WORD;
-              stop = lim - start;
-              if (stop > BITS_PER_BITS_WORD)
-                stop = BITS_PER_BITS_WORD;
-              stop += start;
+  for (cblk = cons_block, i = 0; cblk; cblk = *cprev, i++)
+    {
+      struct cons_sweep_block local, *b = &local;
 
-              for (pos = start; pos < stop; pos++)
-                {
-		  struct Lisp_Cons *acons
-		    = ptr_bounds_copy (&cblk->conses[pos], cblk);
-		  if (!CONS_MARKED_P (acons))
-                    {
-                      this_free++;
-                      cblk->conses[pos].u.s.u.chain = cons_free_list;
-                      cons_free_list = &cblk->conses[pos];
-                      cons_free_list->u.s.car = Vdead;
-                    }
-                  else
-                    {
-                      num_used++;
-		      CONS_UNMARK (acons);
-                    }
-                }
-            }
-        }
+#ifdef HAVE_PTHREAD
+      if (swept)
+	b = &cons_sweep_blocks[i];
+      else
+#endif
+	{
+	  b->block = cblk;
+	  b->lim = lim;
+	  sweep_cons_block (b);
+	}
 
       lim = CONS_BLOCK_SIZE;
       /* If this block contains only free conses and we have already
          seen more than two blocks worth of free conses then deallocate
          this block.  */
-      if (this_free == CONS_BLOCK_SIZE && num_free > CONS_BLOCK_SIZE)
+      if (b->nfree == CONS_BLOCK_SIZE && num_free > CONS_BLOCK_SIZE)
         {
           *cprev = cblk->next;
-          /* Unhook from the free list.  */
-          cons_free_list = cblk->conses[0].u.s.u.chain;
           lisp_align_free (cblk);
         }
       else
         {
-          num_free += this_free;
+          if (b->free)
+            {
+              b->tail->u.s.u.chain = cons_free_list;
+              cons_free_list = b->free;
+            }
+          num_free += b->nfree;
+          num_used += b->lim - b->nfree;
           cprev = &cblk->next;
         }
     }
@@ -6795,46 +7611,52 @@ NO_INLINE /* For better stack traces */
 static void
 sweep_floats (void)
 {
-  register struct float_block *fblk;
+  struct float_block *fblk;
   struct float_block **fprev = &float_block;
-  register int lim = float_block_index;
+  int lim = float_block_index;
   EMACS_INT num_free = 0, num_used = 0;
+  ptrdiff_t i;
 
   float_free_list = 0;
 
-  for (fblk = float_block; fblk; fblk = *fprev)
+#ifdef HAVE_PTHREAD
+  /* Float blocks are as independent as cons blocks.  */
+  bool swept = sweep_float_blocks_parallel ();
+#endif
+
+  for (fblk = float_block, i = 0; fblk; fblk = *fprev, i++)
     {
-      register int i;
-      int this_free = 0;
-      for (i = 0; i < lim; i++)
+      struct float_sweep_block local, *b = &local;
+
+#ifdef HAVE_PTHREAD
+      if (swept)
+	b = &float_sweep_blocks[i];
+      else
+#endif
 	{
-	  struct Lisp_Float *afloat = ptr_bounds_copy (&fblk->floats[i], fblk);
-	  if (!FLOAT_MARKED_P (afloat))
-	    {
-	      this_free++;
-	      fblk->floats[i].u.chain = float_free_list;
-	      float_free_list = &fblk->floats[i];
-	    }
-	  else
-	    {
-	      num_used++;
-	      FLOAT_UNMARK (afloat);
-	    }
+	  b->block = fblk;
+	  b->lim = lim;
+	  sweep_float_block (b);
 	}
+
       lim = FLOAT_BLOCK_SIZE;
       /* If this block contains only free floats and we have already
          seen more than two blocks worth of free floats then deallocate
          this block.  */
-      if (this_free == FLOAT_BLOCK_SIZE && num_free > FLOAT_BLOCK_SIZE)
+      if (b->nfree == FLOAT_BLOCK_SIZE && num_free > FLOAT_BLOCK_SIZE)
         {
           *fprev = fblk->next;
-          /* Unhook from the free list.  */
-          float_free_list = fblk->floats[0].u.chain;
           lisp_align_free (fblk);
         }
       else
         {
-          num_free += this_free;
+          if (b->free)
+            {
+              b->tail->u.chain = float_free_list;
+              float_free_list = b->free;
+            }
+          num_free += b->nfree;
+          num_used += b->lim - b->nfree;
           fprev = &fblk->next;
         }
     }
@@ -7063,17 +7885,29 @@ gc_sweep (void)
   /* Remove or mark entries in weak hash tables.
      This must be done before any object is unmarked.  */
   sweep_weak_hash_tables ();
+  gc_phase_end (GC_PHASE_SWEEP_WEAK);
 
   sweep_strings ();
+  /* Charge the consistency checks of string data to compaction, not
+     to whatever phase happens to follow them.  */
   check_string_bytes (!noninteractive);
+  gc_phase_end (GC_PHASE_COMPACT_STRINGS);
   sweep_conses ();
+  gc_phase_end (GC_PHASE_SWEEP_CONSES);
   sweep_floats ();
+  gc_phase_end (GC_PHASE_SWEEP_FLOATS);
   sweep_intervals ();
+  gc_phase_end (GC_PHASE_SWEEP_INTERVALS);
   sweep_symbols ();
+  gc_phase_end (GC_PHASE_SWEEP_SYMBOLS);
   sweep_misc ();
+  gc_phase_end (GC_PHASE_SWEEP_MISC);
   sweep_buffers ();
+  gc_phase_end (GC_PHASE_SWEEP_BUFFERS);
   sweep_vectors ();
+  gc_phase_end (GC_PHASE_SWEEP_VECTORS);
   check_string_bytes (!noninteractive);
+  gc_phase_end (GC_PHASE_COMPACT_STRINGS);
 }
 
 DEFUN ("memory-info", Fmemory_info, Smemory_info, 0, 0, 0,
@@ -7114,6 +7948,30 @@ or memory information can't be obtained, return nil.  */)
 #endif
 }
 
+#ifdef HAVE_MALLOC_TRIM
+DEFUN ("malloc-trim", Fmalloc_trim, Smalloc_trim, 0, 1, "",
+       doc: /* Return free heap memory to the operating system.
+Unused memory at the top of the heap, and whole free pages inside it,
+are handed back to the system.  If PAD is non-nil, it should be a
+number of bytes of free space to keep at the top of the heap.
+Return non-nil if any memory was returned.  */)
+  (Lisp_Object pad)
+{
+  size_t padding = 0;
+
+  if (!NILP (pad))
+    {
+      CHECK_NATNUM (pad);
+      padding = XFASTINT (pad);
+    }
+
+  block_input ();
+  int released = malloc_trim (padding);
+  unblock_input ();
+  return released ? Qt : Qnil;
+}
+#endif
+
 /* Debugging aids.  */
 
 DEFUN ("memory-limit", Fmemory_limit, Smemory_limit, 0, 0, 0,
@@ -7370,6 +8228,38 @@ has been allocated since the last garbage collection.
 If this portion is smaller than `gc-cons-threshold', this is ignored.  */);
   Vgc_cons_percentage = make_float (0.1);
 
+  DEFVAR_LISP ("gc-idle-cons-fraction", Vgc_idle_cons_fraction,
+	       doc: /* Portion of the GC threshold after which to collect when idle.
+If this is a float between 0 and 1, garbage collection happens while
+Emacs waits for input as soon as this fraction of the amount that
+would trigger an automatic collection has been allocated, so that the
+pause is less likely to interrupt typing.  Any other value means only
+collect when the full threshold is reached.
+See `gc-cons-threshold' and `gc-cons-percentage'.  */);
+  Vgc_idle_cons_fraction = Qnil;
+
+  DEFVAR_INT ("gc-sweep-threads", gc_sweep_threads,
+	      doc: /* Number of threads that sweep cons cells and floats after marking.
+With a value greater than 1, garbage collection splits the cons and
+float blocks of a large heap among that many threads, the current one
+included.
+Small heaps are always swept by the current thread alone.  */);
+  gc_sweep_threads = 1;
+
+  DEFVAR_LISP ("gc-malloc-trim-threshold", Vgc_malloc_trim_threshold,
+	       doc: /* Bytes a garbage collection must free to return memory to the system.
+If this is a natural number and a garbage collection frees at least
+that many bytes of Lisp data, Emacs then calls `malloc-trim' to give
+unused heap memory back to the operating system, so that its memory
+footprint shrinks after the live heap does.  A value of nil means
+never do that automatically.  This has no effect on systems that lack
+`malloc-trim'.  */);
+  Vgc_malloc_trim_threshold = Qnil;
+
+  DEFVAR_INT ("gc-malloc-trims", gc_malloc_trims,
+	      doc: /* Number of times garbage collection has called `malloc-trim'.
+See `gc-malloc-trim-threshold'.  */);
+
   DEFVAR_INT ("pure-bytes-used", pure_bytes_used,
 	      doc: /* Number of bytes of shareable Lisp data allocated so far.  */);
 
@@ -7443,6 +8333,38 @@ do hash-consing of the objects allocated to pure space.  */);
   DEFSYM (Qgc_cons_threshold, "gc-cons-threshold");
   DEFSYM (Qchar_table_extra_slots, "char-table-extra-slots");
 
+  DEFVAR_LISP ("gc-target-pause", Vgc_target_pause,
+	       doc: /* Desired maximum length of a garbage collection pause, in seconds.
+If this is a positive float, automatic garbage collection uses a
+threshold computed after every collection from the observed marking
+and sweeping speed and the size of the live heap, instead of
+`gc-cons-threshold' and `gc-cons-percentage', aiming for pauses no
+longer than this.  While that policy is in effect, collection is put
+off while input is pending, up to twice the computed threshold, and
+binding `gc-cons-threshold' to `most-positive-fixnum' still prevents
+automatic collection.  Any other value means no pause target.
+See also `gc-target-overhead' and `gc-statistics'.  */);
+  Vgc_target_pause = Qnil;
+
+  DEFVAR_LISP ("gc-target-overhead", Vgc_target_overhead,
+	       doc: /* Desired maximum fraction of run time spent collecting garbage.
+If this is a float between 0 and 1, automatic garbage collection uses
+a threshold computed after every collection from the observed
+collection speed and allocation rate, aiming to spend no more than
+this portion of the time in the collector.  If `gc-target-pause' is
+also set and the two conflict, the pause target wins.  Any other value
+means no overhead target.  See `gc-target-pause' for details.  */);
+  Vgc_target_overhead = Qnil;
+
+  DEFVAR_LISP ("gc-statistics-functions", Vgc_statistics_functions,
+	       doc: /* Functions to call after each garbage collection.
+Each function is called with one argument, the timing of that
+collection, in the form used for elements of RECENT in the value of
+`gc-statistics'.  Garbage collection is inhibited while they run.  */);
+  Vgc_statistics_functions = Qnil;
+  DEFSYM (Qgc_statistics_functions, "gc-statistics-functions");
+  DEFSYM (Qtotal, "total");
+
   DEFVAR_LISP ("gc-elapsed", Vgc_elapsed,
 	       doc: /* Accumulated time elapsed in garbage collections.
 The time is in seconds as a floating point value.  */);
@@ -7463,6 +8385,10 @@ The time is in seconds as a floating point value.  */);
   defsubr (&Sgarbage_collect);
   defsubr (&Smemory_limit);
   defsubr (&Smemory_info);
+  defsubr (&Sgc_statistics);
+#ifdef HAVE_MALLOC_TRIM
+  defsubr (&Smalloc_trim);
+#endif
   defsubr (&Ssuspicious_object);
 }
 
@@ -438,6 +438,8 @@ even if it is dead.  The return value is never nil.  */)
   BUF_END_UNCHANGED (b) = 0;
   BUF_BEG_UNCHANGED (b) = 0;
   *(BUF_GPT_ADDR (b)) = *(BUF_Z_ADDR (b)) = 0; /* Put an anchor '\0'.  */
+  b->text->bytechar_index = NULL;
+  b->text->line_index = NULL;
   b->text->inhibit_shrinking = false;
   b->text->redisplay = false;
 
@@ -1244,28 +1246,35 @@ compact_buffer (struct buffer *buffer)
 {
   BUFFER_CHECK_INDIRECTION (buffer);
 
-  /* Skip dead buffers, indirect buffers and buffers
-     which aren't changed since last compaction.  */
-  if (BUFFER_LIVE_P (buffer)
-      && (buffer->base_buffer == NULL)
-      && (BUF_COMPACT (buffer) != BUF_MODIFF (buffer)))
+  /* Skip dead buffers and indirect buffers.  */
+  if (BUFFER_LIVE_P (buffer) && (buffer->base_buffer == NULL))
     {
+      bool modified = BUF_COMPACT (buffer) != BUF_MODIFF (buffer);
+
       /* If a buffer's undo list is Qt, that means that undo is
 	 turned off in that buffer.  Calling truncate_undo_list on
 	 Qt tends to return NULL, which effectively turns undo back on.
 	 So don't call truncate_undo_list if undo_list is Qt.  */
-      if (!EQ (BVAR(buffer, undo_list), Qt))
+      if (modified && !EQ (BVAR(buffer, undo_list), Qt))
 	truncate_undo_list (buffer);
 
       /* Shrink buffer gaps.  */
       if (!buffer->text->inhibit_shrinking)
 	{
-	  /* If a buffer's gap size is more than 10% of the buffer
-	     size, or larger than GAP_BYTES_DFL bytes, then shrink it
-	     accordingly.  Keep a minimum size of GAP_BYTES_MIN bytes.  */
-	  ptrdiff_t size = clip_to_bounds (GAP_BYTES_MIN,
-					   BUF_Z_BYTE (buffer) / 10,
-					   GAP_BYTES_DFL);
+	  /* A buffer changed since the last compaction may still be
+	     growing, so leave it a reserve in proportion to its size
+	     as make_gap_larger does; otherwise it would reallocate its
+	     text again right after each garbage collection.  Once it
+	     stays unchanged, shrink the gap to 10% of the buffer size
+	     and at most GAP_BYTES_DFL bytes.  Keep a minimum size of
+	     GAP_BYTES_MIN bytes.  */
+	  ptrdiff_t size
+	    = (modified
+	       ? clip_to_bounds (GAP_BYTES_MIN,
+				 BUF_Z_BYTE (buffer) / GAP_GROWTH_DIVISOR,
+				 GAP_BYTES_GROWTH_MAX)
+	       : clip_to_bounds (GAP_BYTES_MIN, BUF_Z_BYTE (buffer) / 10,
+				 GAP_BYTES_DFL));
 	  if (BUF_GAP_SIZE (buffer) > size)
 	    make_gap_1 (buffer, -(BUF_GAP_SIZE (buffer) - size));
 	}
@@ -2227,6 +2236,10 @@ current buffer is cleared.  */)
       set_intervals_multibyte (1);
     }
 
+  /* Positions indexed while the text was being converted are stale.  */
+  truncate_bytechar_index (current_buffer, BEG);
+  free_line_index (current_buffer);
+
   if (!EQ (old_undo, Qt))
     {
       /* Represent all the above changes by a special undo entry.  */
@@ -3025,124 +3038,129 @@ overlay_strings (ptrdiff_t pos, struct window *w, unsigned char **pstr)
   return 0;
 }
 
-/* Shift overlays in BUF's overlay lists, to center the lists at POS.  */
+/* The sort key of overlay O in overlays_after if BY_START, where
+   overlays are ordered by increasing start position, or else in
+   overlays_before, where they are ordered by decreasing end position.  */
 
-void
-recenter_overlay_lists (struct buffer *buf, ptrdiff_t pos)
+static ptrdiff_t
+overlay_chain_key (struct Lisp_Overlay *o, bool by_start)
 {
-  Lisp_Object overlay, beg, end;
-  struct Lisp_Overlay *prev, *tail, *next;
+  return (by_start
+	  ? OVERLAY_POSITION (o->start)
+	  : - OVERLAY_POSITION (o->end));
+}
 
-  /* See if anything in overlays_before should move to overlays_after.  */
+/* Merge the overlay chains A and B, both ordered by overlay_chain_key,
+   into one such chain and return it.  On ties, overlays of A come
+   first.  */
 
-  /* We don't strictly need prev in this loop; it should always be nil.
-     But we use it for symmetry and in case that should cease to be true
-     with some future change.  */
-  prev = NULL;
-  for (tail = buf->overlays_before; tail; prev = tail, tail = next)
-    {
-      next = tail->next;
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
+static struct Lisp_Overlay *
+merge_overlay_chains (struct Lisp_Overlay *a, struct Lisp_Overlay *b,
+		      bool by_start)
+{
+  struct Lisp_Overlay *head = NULL, **tailp = &head;
 
-      beg = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
+  while (a && b)
+    if (overlay_chain_key (b, by_start) < overlay_chain_key (a, by_start))
+      {
+	*tailp = b;
+	tailp = &b->next;
+	b = b->next;
+      }
+    else
+      {
+	*tailp = a;
+	tailp = &a->next;
+	a = a->next;
+      }
+  *tailp = a ? a : b;
+  return head;
+}
 
-      if (OVERLAY_POSITION (end) > pos)
-	{
-	  /* OVERLAY needs to be moved.  */
-	  ptrdiff_t where = OVERLAY_POSITION (beg);
-	  struct Lisp_Overlay *other, *other_prev;
+/* Sort the overlay chain LIST by overlay_chain_key and return it.  */
 
-	  /* Splice the cons cell TAIL out of overlays_before.  */
-	  if (prev)
-	    prev->next = next;
-	  else
-	    set_buffer_overlays_before (buf, next);
+static struct Lisp_Overlay *
+sort_overlay_chain (struct Lisp_Overlay *list, bool by_start)
+{
+  if (!list || !list->next)
+    return list;
 
-	  /* Search thru overlays_after for where to put it.  */
-	  other_prev = NULL;
-	  for (other = buf->overlays_after; other;
-	       other_prev = other, other = other->next)
-	    {
-	      Lisp_Object otherbeg, otheroverlay;
+  /* Split LIST in two halves.  */
+  struct Lisp_Overlay *slow = list, *fast = list->next;
+  while (fast && fast->next)
+    {
+      slow = slow->next;
+      fast = fast->next->next;
+    }
+  struct Lisp_Overlay *second = slow->next;
+  slow->next = NULL;
 
-	      XSETMISC (otheroverlay, other);
-	      eassert (OVERLAYP (otheroverlay));
+  return merge_overlay_chains (sort_overlay_chain (list, by_start),
+			       sort_overlay_chain (second, by_start),
+			       by_start);
+}
 
-	      otherbeg = OVERLAY_START (otheroverlay);
-	      if (OVERLAY_POSITION (otherbeg) >= where)
-		break;
-	    }
+/* Shift overlays in BUF's overlay lists, to center the lists at POS.
 
-	  /* Add TAIL to overlays_after before OTHER.  */
-	  tail->next = other;
-	  if (other_prev)
-	    other_prev->next = tail;
-	  else
-	    set_buffer_overlays_after (buf, tail);
-	  tail = prev;
-	}
-      else
-	/* We've reached the things that should stay in overlays_before.
-	   All the rest of overlays_before must end even earlier,
-	   so stop now.  */
-	break;
+   The overlays that change lists are gathered, sorted and then merged
+   into their new list in one pass, rather than inserted one at a time,
+   so that moving the center across many overlays is not quadratic.  */
+
+void
+recenter_overlay_lists (struct buffer *buf, ptrdiff_t pos)
+{
+  struct Lisp_Overlay *prev, *tail, *next, *moved;
+
+  /* See if anything in overlays_before should move to overlays_after.
+     Since overlays_before is ordered by decreasing end position, those
+     are a prefix of it: all the rest must end even earlier.  */
+  prev = NULL;
+  for (tail = buf->overlays_before;
+       tail && OVERLAY_POSITION (tail->end) > pos;
+       tail = tail->next)
+    prev = tail;
+
+  if (prev)
+    {
+      moved = buf->overlays_before;
+      set_buffer_overlays_before (buf, prev->next);
+      prev->next = NULL;
+      set_buffer_overlays_after
+	(buf, merge_overlay_chains (sort_overlay_chain (moved, true),
+				    buf->overlays_after, true));
     }
 
   /* See if anything in overlays_after should be in overlays_before.  */
+  moved = NULL;
   prev = NULL;
-  for (tail = buf->overlays_after; tail; prev = tail, tail = next)
+  for (tail = buf->overlays_after; tail; tail = next)
     {
       next = tail->next;
-      XSETMISC (overlay, tail);
-      eassert (OVERLAYP (overlay));
-
-      beg = OVERLAY_START (overlay);
-      end = OVERLAY_END (overlay);
 
       /* Stop looking, when we know that nothing further
 	 can possibly end before POS.  */
-      if (OVERLAY_POSITION (beg) > pos)
+      if (OVERLAY_POSITION (tail->start) > pos)
 	break;
 
-      if (OVERLAY_POSITION (end) <= pos)
+      if (OVERLAY_POSITION (tail->end) <= pos)
 	{
-	  /* OVERLAY needs to be moved.  */
-	  ptrdiff_t where = OVERLAY_POSITION (end);
-	  struct Lisp_Overlay *other, *other_prev;
-
-	  /* Splice the cons cell TAIL out of overlays_after.  */
+	  /* Splice TAIL out of overlays_after and onto MOVED.  */
 	  if (prev)
 	    prev->next = next;
 	  else
 	    set_buffer_overlays_after (buf, next);
-
-	  /* Search thru overlays_before for where to put it.  */
-	  other_prev = NULL;
-	  for (other = buf->overlays_before; other;
-	       other_prev = other, other = other->next)
-	    {
-	      Lisp_Object otherend, otheroverlay;
-
-	      XSETMISC (otheroverlay, other);
-	      eassert (OVERLAYP (otheroverlay));
-
-	      otherend = OVERLAY_END (otheroverlay);
-	      if (OVERLAY_POSITION (otherend) <= where)
-		break;
-	    }
-
-	  /* Add TAIL to overlays_before before OTHER.  */
-	  tail->next = other;
-	  if (other_prev)
-	    other_prev->next = tail;
-	  else
-	    set_buffer_overlays_before (buf, tail);
-	  tail = prev;
+	  tail->next = moved;
+	  moved = tail;
 	}
+      else
+	prev = tail;
     }
 
+  if (moved)
+    set_buffer_overlays_before
+      (buf, merge_overlay_chains (sort_overlay_chain (moved, false),
+				  buf->overlays_before, false));
+
   buf->overlay_center = pos;
 }
 
@@ -4511,6 +4529,8 @@ free_buffer_text (struct buffer *b)
 #endif
 
   BUF_BEG_ADDR (b) = NULL;
+  free_bytechar_index (b);
+  free_line_index (b);
   unblock_input ();
 }
 
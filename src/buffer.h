@@ -318,11 +318,21 @@ extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
 #define BUF_BYTES_MAX \
   (ptrdiff_t) min (MOST_POSITIVE_FIXNUM - 1, min (SIZE_MAX, PTRDIFF_MAX))
 
-/* Maximum gap size after compact_buffer, in bytes.  Also
-   used in make_gap_larger to get some extra reserved space.  */
+/* Minimum gap reserve in make_gap_larger, and maximum gap size after
+   compact_buffer for buffers that did not change since the previous
+   compaction, in bytes.  */
 
 #define GAP_BYTES_DFL 2000
 
+/* When make_gap_larger has to enlarge the buffer text, it reserves
+   1/GAP_GROWTH_DIVISOR of the current size on top of what was asked
+   for, but at least GAP_BYTES_DFL and at most GAP_BYTES_GROWTH_MAX
+   bytes.  compact_buffer leaves a changed buffer a gap of up to
+   1/GAP_GROWTH_DIVISOR of its size too.  */
+
+#define GAP_GROWTH_DIVISOR 8
+#define GAP_BYTES_GROWTH_MAX (64 * 1024 * 1024)
+
 /* Minimum gap size after compact_buffer, in bytes.  Also
    used in make_gap_smaller to avoid too small gap size.  */
 
@@ -429,6 +439,47 @@ extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
 
 /* Define the actual buffer data structures.  */
 
+/* A sparse index of known character and byte positions in a buffer's
+   text, used by buf_charpos_to_bytepos and buf_bytepos_to_charpos when
+   no marker is close to the position they convert.  See insdel.c.  */
+
+struct bytechar_index
+  {
+    /* Known positions, in increasing order.  Entries from SHIFT_FROM
+       on are still to be moved by SHIFT_CHARS and SHIFT_BYTES; this
+       lets repeated edits at the same place update the index in
+       constant time.  */
+    struct bytechar_entry
+    {
+      ptrdiff_t charpos, bytepos;
+    } *entries;
+    ptrdiff_t nentries, size;
+    ptrdiff_t shift_from, shift_chars, shift_bytes;
+  };
+
+/* An index of the newlines in a buffer's text, used to count lines and
+   to find the start of a line in logarithmic time.  The text is split
+   into blocks whose lengths and newline counts are kept in two Fenwick
+   trees.  Edits adjust the lengths right away and leave the blocks they
+   touch to be recounted by the next query.  See insdel.c.  */
+
+enum { LINE_INDEX_DIRTY_MAX = 64 };
+
+struct line_index
+  {
+    /* Number of blocks, and the Fenwick trees, indexed from 1, of
+       their lengths in bytes and of the newlines in them.  */
+    ptrdiff_t nblocks;
+    ptrdiff_t *bytes, *newlines;
+
+    /* Sum of the block lengths, checked against the text.  */
+    ptrdiff_t total_bytes;
+
+    /* Blocks changed since their newlines were counted.  */
+    int ndirty;
+    ptrdiff_t dirty[LINE_INDEX_DIRTY_MAX];
+  };
+
 /* This data structure describes the actual text contents of a buffer.
    It is shared between indirect buffers and their base buffer.  */
 
@@ -488,6 +539,13 @@ struct buffer_text
        to move a marker within a buffer.  */
     struct Lisp_Marker *markers;
 
+    /* Index of positions far from any marker, or NULL if none has been
+       needed yet.  */
+    struct bytechar_index *bytechar_index;
+
+    /* Index of line starts, or NULL if none has been needed yet.  */
+    struct line_index *line_index;
+
     /* Usually false.  Temporarily true in decode_coding_gap to
        prevent Fgarbage_collect from shrinking the gap and losing
        not-yet-decoded bytes.  */
@@ -6198,15 +6198,17 @@ check_ascii (struct coding_system *coding)
   src = coding->source;
   end = src + coding->src_bytes;
 
+  ptrdiff_t nascii = ascii_prefix_length (src, end - src);
+
   if (inhibit_eol_conversion
-      || SYMBOLP (eol_type))
+      || SYMBOLP (eol_type)
+      || !memchr (src, '\r', nascii))
     {
-      /* We don't have to check EOL format.  */
-      while (src < end && !( *src & 0x80))
-	{
-	  if (*src++ == '\n')
-	    eol_seen |= EOL_SEEN_LF;
-	}
+      /* We don't have to check EOL format, or the ASCII head has no
+	 CR and so the only EOL it can contain is a bare LF.  */
+      if (memchr (src, '\n', nascii))
+	eol_seen |= EOL_SEEN_LF;
+      src += nascii;
     }
   else
     {
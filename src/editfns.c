@@ -1691,6 +1691,18 @@ determines whether case is significant or ignored.  */)
 }
 
 
+/* The lines of the accessible portion of a buffer, as used by
+   Freplace_buffer_contents.  Line I spans the character offsets
+   CHARPOS[I] to CHARPOS[I + 1] from BEGV and the corresponding byte
+   positions, including its newline; HASH[I] is a hash of its bytes.  */
+
+struct line_table
+{
+  ptrdiff_t nlines;
+  ptrdiff_t *charpos, *bytepos;
+  EMACS_UINT *hash;
+};
+
 /* Set up necessary definitions for diffseq.h; see comments in
    diffseq.h for explanation.  */
 
@@ -1698,7 +1710,9 @@ determines whether case is significant or ignored.  */)
 #undef EQUAL
 
 #define XVECREF_YVECREF_EQUAL(ctx, xoff, yoff)  \
-  buffer_chars_equal ((ctx), (xoff), (yoff))
+  ((ctx)->lines_a                               \
+   ? buffer_lines_equal ((ctx), (xoff), (yoff)) \
+   : buffer_chars_equal ((ctx), (xoff), (yoff)))
 
 #define OFFSET ptrdiff_t
 
@@ -1706,31 +1720,109 @@ determines whether case is significant or ignored.  */)
   /* Buffers to compare.  */                    \
   struct buffer *buffer_a;                      \
   struct buffer *buffer_b;                      \
-  /* Bit vectors recording for each character whether it was deleted
+  /* If non-null, the elements compared are the lines in these
+     tables rather than characters.  */         \
+  struct line_table *lines_a;                   \
+  struct line_table *lines_b;                   \
+  /* Bit vectors recording for each element whether it was deleted
      or inserted.  */                           \
   unsigned char *deletions;                     \
-  unsigned char *insertions;
+  unsigned char *insertions;                    \
+  /* When to give up, or an invalid time for no limit.  */ \
+  struct timespec time_limit;
 
 #define NOTE_DELETE(ctx, xoff) set_bit ((ctx)->deletions, (xoff))
 #define NOTE_INSERT(ctx, yoff) set_bit ((ctx)->insertions, (yoff))
+#define EARLY_ABORT(ctx) compareseq_early_abort (ctx)
+#define USE_HEURISTIC
 
 struct context;
 static void set_bit (unsigned char *, OFFSET);
 static bool bit_is_set (const unsigned char *, OFFSET);
 static bool buffer_chars_equal (struct context *, OFFSET, OFFSET);
+static bool buffer_lines_equal (struct context *, OFFSET, OFFSET);
+static bool compareseq_early_abort (struct context *);
 
 #include "minmax.h"
 #include "diffseq.h"
 
+/* Fill in LINES with the lines of the accessible portion of buffer B.
+   This allocates with SAFE_NALLOCA, so it needs USE_SAFE_ALLOCA.  */
+
+#define MAKE_LINE_TABLE(lines, b)					\
+  do {									\
+    ptrdiff_t nl_ = 1 + buf_count_newlines (b, BUF_BEGV_BYTE (b),	\
+					    BUF_ZV_BYTE (b));		\
+    SAFE_NALLOCA ((lines).charpos, 1, nl_ + 1);				\
+    SAFE_NALLOCA ((lines).bytepos, 1, nl_ + 1);				\
+    SAFE_NALLOCA ((lines).hash, 1, nl_);				\
+    fill_line_table (&(lines), b);					\
+  } while (false)
+
+static void
+fill_line_table (struct line_table *lines, struct buffer *b)
+{
+  bool multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+  ptrdiff_t n = 0, charpos = 0;
+  EMACS_UINT hash = 0;
+
+  lines->charpos[0] = 0;
+  lines->bytepos[0] = BUF_BEGV_BYTE (b);
+  for (ptrdiff_t p = BUF_BEGV_BYTE (b); p < BUF_ZV_BYTE (b); p++)
+    {
+      unsigned char c = BUF_FETCH_BYTE (b, p);
+      hash = sxhash_combine (hash, c);
+      charpos += !multibyte || CHAR_HEAD_P (c);
+      if (c == '\n')
+	{
+	  lines->hash[n++] = hash;
+	  lines->charpos[n] = charpos;
+	  lines->bytepos[n] = p + 1;
+	  hash = 0;
+	}
+    }
+
+  /* The text after the last newline, if any, is a line too.  */
+  if (lines->bytepos[n] < BUF_ZV_BYTE (b))
+    {
+      lines->hash[n++] = hash;
+      lines->charpos[n] = charpos;
+      lines->bytepos[n] = BUF_ZV_BYTE (b);
+    }
+  lines->nlines = n;
+}
+
 DEFUN ("replace-buffer-contents", Freplace_buffer_contents,
-       Sreplace_buffer_contents, 1, 1, "bSource buffer: ",
+       Sreplace_buffer_contents, 1, 3, "bSource buffer: ",
        doc: /* Replace accessible portion of current buffer with that of SOURCE.
 SOURCE can be a buffer or a string that names a buffer.
 Interactively, prompt for SOURCE.
+
 As far as possible the replacement is non-destructive, i.e. existing
 buffer contents, markers, properties, and overlays in the current
-buffer stay intact.  */)
-  (Lisp_Object source)
+buffer stay intact.  The difference is computed line by line first,
+and then character by character within the lines that changed.
+
+Because this function can be very slow if there is a large number of
+differences between the two buffers, there are two optional arguments
+mitigating this issue.
+
+The MAX-SECS argument, if given, defines a hard limit on the time used
+for comparing the buffers.  If it takes longer than MAX-SECS, the
+function falls back to a plain `delete-region' and
+`insert-buffer-substring'.  (Note that the checks are not performed
+too evenly over time, so in some cases it may run a bit longer than
+allowed).
+
+The optional argument MAX-COSTS defines the quality of the difference
+computation.  If the actual costs exceed this limit, heuristics are
+used to provide a faster but suboptimal solution.  The default value
+is 1000000.
+
+This function returns t if a non-destructive replacement could be
+performed.  Otherwise, i.e., if MAX-SECS was exceeded, it returns
+nil.  */)
+  (Lisp_Object source, Lisp_Object max_secs, Lisp_Object max_costs)
 {
   struct buffer *a = current_buffer;
   Lisp_Object source_buffer = Fget_buffer (source);
@@ -1742,6 +1834,24 @@ buffer stay intact.  */)
   if (a == b)
     error ("Cannot replace a buffer with itself");
 
+  ptrdiff_t too_expensive;
+  if (NILP (max_costs))
+    too_expensive = 1000000;
+  else
+    {
+      CHECK_NATNUM (max_costs);
+      too_expensive = clip_to_bounds (0, XFASTINT (max_costs),
+				      PTRDIFF_MAX);
+    }
+
+  struct timespec time_limit = make_timespec (0, -1);
+  if (!NILP (max_secs))
+    {
+      CHECK_NUMBER_OR_FLOAT (max_secs);
+      struct timespec tlim = dtotimespec (XFLOATINT (max_secs));
+      time_limit = timespec_add (current_timespec (), tlim);
+    }
+
   ptrdiff_t min_a = BEGV;
   ptrdiff_t min_b = BUF_BEGV (b);
   ptrdiff_t size_a = ZV - min_a;
@@ -1755,15 +1865,18 @@ buffer stay intact.  */)
      empty.  */
 
   if (a_empty && b_empty)
-    return Qnil;
+    return Qt;
 
   if (a_empty)
-    return Finsert_buffer_substring (source, Qnil, Qnil);
+    {
+      Finsert_buffer_substring (source, Qnil, Qnil);
+      return Qt;
+    }
 
   if (b_empty)
     {
       del_range_both (BEGV, BEGV_BYTE, ZV, ZV_BYTE, true);
-      return Qnil;
+      return Qt;
     }
 
   /* FIXME: It is not documented how to initialize the contents of the
@@ -1784,25 +1897,101 @@ buffer stay intact.  */)
     .buffer_b = b,
     .deletions = SAFE_ALLOCA (del_bytes),
     .insertions = SAFE_ALLOCA (ins_bytes),
+    .time_limit = time_limit,
     .fdiag = buffer + size_b + 1,
     .bdiag = buffer + diags + size_b + 1,
-    /* FIXME: Find a good number for .too_expensive.  */
-    .too_expensive = 1000000,
+    .heuristic = true,
+    .too_expensive = too_expensive,
   };
   memclear (ctx.deletions, del_bytes);
   memclear (ctx.insertions, ins_bytes);
+
   /* compareseq requires indices to be zero-based.  We add BEGV back
      later.  */
-  bool early_abort = compareseq (0, size_a, 0, size_b, false, &ctx);
-  /* Since we didn’t define EARLY_ABORT, we should never abort
-     early.  */
-  eassert (! early_abort);
-  SAFE_FREE ();
+  bool early_abort;
+  if (NILP (BVAR (a, enable_multibyte_characters))
+      != NILP (BVAR (b, enable_multibyte_characters)))
+    /* Lines with equal bytes may then differ, so compare characters
+       throughout.  */
+    early_abort = compareseq (0, size_a, 0, size_b, false, &ctx);
+  else
+    {
+      /* Find the lines that changed, then compare the characters of
+	 each run of changed lines.  Most edits touch few lines, so this
+	 keeps the character comparison small.  */
+      struct line_table lines_a, lines_b;
+      MAKE_LINE_TABLE (lines_a, a);
+      MAKE_LINE_TABLE (lines_b, b);
+
+      ptrdiff_t na = lines_a.nlines, nb = lines_b.nlines;
+      unsigned char *char_deletions = ctx.deletions;
+      unsigned char *char_insertions = ctx.insertions;
+      ptrdiff_t line_del_bytes = (size_t) na / CHAR_BIT + 1;
+      ptrdiff_t line_ins_bytes = (size_t) nb / CHAR_BIT + 1;
+      ctx.lines_a = &lines_a;
+      ctx.lines_b = &lines_b;
+      ctx.deletions = SAFE_ALLOCA (line_del_bytes);
+      ctx.insertions = SAFE_ALLOCA (line_ins_bytes);
+      memclear (ctx.deletions, line_del_bytes);
+      memclear (ctx.insertions, line_ins_bytes);
+
+      early_abort = compareseq (0, na, 0, nb, false, &ctx);
+
+      unsigned char *line_deletions = ctx.deletions;
+      unsigned char *line_insertions = ctx.insertions;
+      ctx.lines_a = ctx.lines_b = NULL;
+      ctx.deletions = char_deletions;
+      ctx.insertions = char_insertions;
+
+      ptrdiff_t i = 0, j = 0;
+      while (!early_abort && (i < na || j < nb))
+	{
+	  if ((i < na && bit_is_set (line_deletions, i))
+	      || (j < nb && bit_is_set (line_insertions, j)))
+	    {
+	      ptrdiff_t beg_i = i, beg_j = j;
+	      while (i < na && bit_is_set (line_deletions, i))
+		i++;
+	      while (j < nb && bit_is_set (line_insertions, j))
+		j++;
+	      early_abort = compareseq (lines_a.charpos[beg_i],
+					lines_a.charpos[i],
+					lines_b.charpos[beg_j],
+					lines_b.charpos[j], false, &ctx);
+	    }
+	  else
+	    {
+	      i++;
+	      j++;
+	    }
+	}
+    }
+
+  if (early_abort)
+    {
+      del_range (min_a, ZV);
+      Finsert_buffer_substring (source, Qnil, Qnil);
+      SAFE_FREE ();
+      return Qnil;
+    }
 
   Fundo_boundary ();
   ptrdiff_t count = SPECPDL_INDEX ();
   record_unwind_protect (save_excursion_restore, save_excursion_save ());
 
+  /* We are going to make a lot of small modifications, and having the
+     modification hooks called for each of them will slow us down.
+     Instead, we announce a single modification for the entire
+     modified region.  But don't do that if the caller inhibited
+     modification hooks, because then they don't want that.  */
+  bool modification_hooks_inhibited = false;
+  if (!inhibit_modification_hooks)
+    {
+      prepare_to_modify_buffer (BEGV, ZV, NULL);
+      specbind (Qinhibit_modification_hooks, Qt);
+      modification_hooks_inhibited = true;
+    }
+
   ptrdiff_t i = size_a;
   ptrdiff_t j = size_b;
   /* Walk backwards through the lists of changes.  This was also
@@ -1844,7 +2033,16 @@ buffer stay intact.  */)
       --j;
     }
 
-  return unbind_to (count, Qnil);
+  unbind_to (count, Qnil);
+  SAFE_FREE ();
+
+  if (modification_hooks_inhibited)
+    {
+      signal_after_change (BEGV, size_a, ZV - BEGV);
+      update_compositions (BEGV, ZV, CHECK_INSIDE);
+    }
+
+  return Qt;
 }
 
 static void
@@ -1890,7 +2088,39 @@ buffer_chars_equal (struct context *ctx,
     == BUF_FETCH_CHAR_AS_MULTIBYTE (ctx->buffer_b, pos_b);
 }
 
-
+/* Return true if lines LINE_A of CTX->buffer_a and LINE_B of
+   CTX->buffer_b have the same text.  Both buffers have the same
+   multibyteness, so comparing their bytes is enough.  */
+
+static bool
+buffer_lines_equal (struct context *ctx,
+                    ptrdiff_t line_a, ptrdiff_t line_b)
+{
+  struct line_table *la = ctx->lines_a, *lb = ctx->lines_b;
+  ptrdiff_t pos_a = la->bytepos[line_a], pos_b = lb->bytepos[line_b];
+  ptrdiff_t len = la->bytepos[line_a + 1] - pos_a;
+
+  if (la->hash[line_a] != lb->hash[line_b]
+      || len != lb->bytepos[line_b + 1] - pos_b)
+    return false;
+  for (ptrdiff_t k = 0; k < len; k++)
+    if (BUF_FETCH_BYTE (ctx->buffer_a, pos_a + k)
+	!= BUF_FETCH_BYTE (ctx->buffer_b, pos_b + k))
+      return false;
+  return true;
+}
+
+/* Return true if the time limit of CTX has passed.  */
+
+static bool
+compareseq_early_abort (struct context *ctx)
+{
+  if (ctx->time_limit.tv_nsec < 0)
+    return false;
+  return timespec_cmp (ctx->time_limit, current_timespec ()) < 0;
+}
+
+
 static void
 subst_char_in_region_unwind (Lisp_Object arg)
 {
@@ -2084,6 +2314,126 @@ Both characters must have the same length of multi-byte form.  */)
 }
 
 
+/* One element of the EDITS argument of Fapply_buffer_edits.  INDEX is
+   its place in EDITS, which orders edits at the same position.  The
+   replacement text is kept separately, where GC can see it.  */
+
+struct buffer_edit
+{
+  ptrdiff_t start, end;
+  ptrdiff_t index;
+};
+
+static int
+compare_buffer_edits (const void *a, const void *b)
+{
+  const struct buffer_edit *x = a, *y = b;
+
+  if (x->start != y->start)
+    return x->start < y->start ? -1 : 1;
+  if (x->end != y->end)
+    return x->end < y->end ? -1 : 1;
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+DEFUN ("apply-buffer-edits", Fapply_buffer_edits, Sapply_buffer_edits,
+       1, 1, 0,
+       doc: /* Apply the replacements in EDITS to the current buffer as one change.
+EDITS is a vector whose elements have the form (START END REPLACEMENT),
+saying to replace the text from START to END with the string
+REPLACEMENT.  All positions refer to the buffer as it is before any of
+the edits, and the edits must not overlap.  Edits at the same position
+are applied in the order they appear in EDITS.
+
+The result is the same as doing the replacements one by one, but the
+before and after change functions are called only once, for the
+region from the smallest START to the largest END, and undo records the
+change of that region as a single deletion and insertion.  The text
+between the edits is part of that region, also for the purpose of
+read-only checks.  */)
+  (Lisp_Object edits)
+{
+  CHECK_VECTOR (edits);
+
+  ptrdiff_t n = ASIZE (edits);
+  if (n == 0)
+    return Qnil;
+
+  struct buffer_edit *e;
+  Lisp_Object *texts;
+  USE_SAFE_ALLOCA;
+  SAFE_NALLOCA (e, 1, n);
+  /* The change functions may modify EDITS, so this must keep the
+     replacements alive.  */
+  SAFE_ALLOCA_LISP (texts, n);
+  memclear (texts, n * word_size);
+
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      Lisp_Object elt = AREF (edits, i);
+      Lisp_Object start = Fcar (elt);
+      Lisp_Object end = Fcar (Fcdr (elt));
+      Lisp_Object text = Fcar (Fcdr (Fcdr (elt)));
+
+      validate_region (&start, &end);
+      CHECK_STRING (text);
+      e[i].start = XINT (start);
+      e[i].end = XINT (end);
+      e[i].index = i;
+      texts[i] = text;
+    }
+
+  qsort (e, n, sizeof *e, compare_buffer_edits);
+  for (ptrdiff_t i = 1; i < n; i++)
+    if (e[i].start < e[i - 1].end)
+      error ("Overlapping edits");
+
+  ptrdiff_t beg = e[0].start, end = e[n - 1].end;
+  ptrdiff_t orig_beg = beg;
+
+  prepare_to_modify_buffer (beg, end, &beg);
+
+  /* The change functions may have inserted or deleted text before
+     BEG; follow it as replace_range does.  */
+  ptrdiff_t shift = beg - orig_beg;
+  end += shift;
+  if (beg < BEGV || ZV < end)
+    args_out_of_range (make_number (beg), make_number (end));
+
+  ptrdiff_t new_end = end;
+  for (ptrdiff_t i = 0; i < n; i++)
+    new_end += SCHARS (texts[e[i].index]) - (e[i].end - e[i].start);
+
+  /* Record the change before making it, as replace_range does, so that
+     record_point still sees an unmodified buffer and records the first
+     change.  */
+  if (!EQ (BVAR (current_buffer, undo_list), Qt))
+    {
+      Lisp_Object deletion = make_buffer_string (beg, end, true);
+      record_insert (beg + SCHARS (deletion), new_end - beg);
+      record_delete (beg, deletion, false);
+    }
+
+  ptrdiff_t count = SPECPDL_INDEX ();
+  record_unwind_protect (subst_char_in_region_unwind,
+			 BVAR (current_buffer, undo_list));
+  bset_undo_list (current_buffer, Qt);
+  specbind (Qinhibit_modification_hooks, Qt);
+
+  /* Working from the end keeps the positions of the edits not yet
+     done valid, and moves the gap across the region only once.  */
+  for (ptrdiff_t i = n - 1; 0 <= i; i--)
+    replace_range (e[i].start + shift, e[i].end + shift, texts[e[i].index],
+		   false, false, true, false);
+
+  unbind_to (count, Qnil);
+  SAFE_FREE ();
+
+  signal_after_change (beg, end - beg, new_end - beg);
+  update_compositions (beg, new_end, CHECK_BORDER);
+  return Qnil;
+}
+
 static Lisp_Object check_translation (ptrdiff_t, ptrdiff_t, ptrdiff_t,
 				      Lisp_Object);
 
@@ -3667,6 +4017,9 @@ Transposing beyond buffer boundaries is an error.  */)
 			 start1_byte, start1_byte + len1_byte,
 			 start2_byte, start2_byte + len2_byte);
       fix_start_end_in_overlays (start1, end2);
+      /* The positions indexed between the regions have moved.  */
+      if (len1 != len2 || len1_byte != len2_byte)
+	truncate_bytechar_index (current_buffer, start1);
     }
   else
     {
@@ -3761,6 +4114,7 @@ functions if all the text being accessed has this property.  */);
   defsubr (&Scompare_buffer_substrings);
   defsubr (&Sreplace_buffer_contents);
   defsubr (&Ssubst_char_in_region);
+  defsubr (&Sapply_buffer_edits);
   defsubr (&Stranslate_region_internal);
   defsubr (&Snarrow_to_region);
   defsubr (&Stranspose_regions);
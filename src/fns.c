@@ -615,10 +615,54 @@ static Lisp_Object string_char_byte_cache_string;
 static ptrdiff_t string_char_byte_cache_charpos;
 static ptrdiff_t string_char_byte_cache_bytepos;
 
+/* Characters between successive entries of the string index.  */
+enum { STRING_BYTECHAR_INTERVAL = 1024 };
+
+/* For string_bytechar_index_string, a long multibyte string, the byte
+   index of every STRING_BYTECHAR_INTERVAL'th character, so that
+   repeated conversions far apart in it need not scan.  */
+static Lisp_Object string_bytechar_index_string;
+static ptrdiff_t *string_bytechar_index;
+static ptrdiff_t string_bytechar_index_size;
+
 void
 clear_string_char_byte_cache (void)
 {
   string_char_byte_cache_string = Qnil;
+  string_bytechar_index_string = Qnil;
+}
+
+/* Return the number of entries of the index for STRING, building it
+   first if needed, or 0 if STRING is not worth indexing.  It is only
+   built for the string of the previous conversion, so that one-off
+   conversions do not pay for it.  */
+
+static ptrdiff_t
+string_bytechar_index_entries (Lisp_Object string)
+{
+  ptrdiff_t nentries = SCHARS (string) / STRING_BYTECHAR_INTERVAL + 1;
+
+  if (EQ (string, string_bytechar_index_string))
+    return nentries;
+  if (! EQ (string, string_char_byte_cache_string) || nentries < 4)
+    return 0;
+
+  if (string_bytechar_index_size < nentries)
+    string_bytechar_index
+      = xpalloc (string_bytechar_index, &string_bytechar_index_size,
+		 nentries - string_bytechar_index_size, -1,
+		 sizeof *string_bytechar_index);
+
+  unsigned char *p = SDATA (string);
+  for (ptrdiff_t i = 0; i < nentries; i++)
+    {
+      string_bytechar_index[i] = p - SDATA (string);
+      if (i + 1 < nentries)
+	for (int j = 0; j < STRING_BYTECHAR_INTERVAL; j++)
+	  p += BYTES_BY_CHAR_HEAD (*p);
+    }
+  string_bytechar_index_string = string;
+  return nentries;
 }
 
 /* Return the byte index corresponding to CHAR_INDEX in STRING.  */
@@ -650,6 +694,18 @@ string_char_to_byte (Lisp_Object string, ptrdiff_t char_index)
 	}
     }
 
+  if (char_index - best_below > STRING_BYTECHAR_INTERVAL
+      && best_above - char_index > STRING_BYTECHAR_INTERVAL)
+    {
+      ptrdiff_t nentries = string_bytechar_index_entries (string);
+      if (nentries)
+	{
+	  ptrdiff_t i = char_index / STRING_BYTECHAR_INTERVAL;
+	  best_below = i * STRING_BYTECHAR_INTERVAL;
+	  best_below_byte = string_bytechar_index[i];
+	}
+    }
+
   if (char_index - best_below < best_above - char_index)
     {
       unsigned char *p = SDATA (string) + best_below_byte;
@@ -710,6 +766,30 @@ string_byte_to_char (Lisp_Object string, ptrdiff_t byte_index)
 	}
     }
 
+  if (byte_index - best_below_byte > STRING_BYTECHAR_INTERVAL
+      && best_above_byte - byte_index > STRING_BYTECHAR_INTERVAL)
+    {
+      ptrdiff_t nentries = string_bytechar_index_entries (string);
+      if (nentries)
+	{
+	  /* Find the last entry at or before BYTE_INDEX.  */
+	  ptrdiff_t lo = 0, hi = nentries;
+	  while (hi - lo > 1)
+	    {
+	      ptrdiff_t mid = lo + (hi - lo) / 2;
+	      if (string_bytechar_index[mid] <= byte_index)
+		lo = mid;
+	      else
+		hi = mid;
+	    }
+	  if (string_bytechar_index[lo] > best_below_byte)
+	    {
+	      best_below = lo * STRING_BYTECHAR_INTERVAL;
+	      best_below_byte = string_bytechar_index[lo];
+	    }
+	}
+    }
+
   if (byte_index - best_below_byte < best_above_byte - byte_index)
     {
       unsigned char *p = SDATA (string) + best_below_byte;
@@ -1442,6 +1522,8 @@ ARRAY is a vector, string, char-table, or bool-vector.  */)
 	    error ("Attempt to change byte length of a string");
 	  for (idx = 0; idx < size_byte; idx++)
 	    *p++ = str[idx % len];
+	  /* The characters may now be laid out differently.  */
+	  clear_string_char_byte_cache ();
 	}
       else
 	for (idx = 0; idx < size; idx++)
@@ -3065,6 +3147,36 @@ extract_data_from_object (Lisp_Object spec,
   return SSDATA (object);
 }
 
+DEFUN ("line-number-at-pos", Fline_number_at_pos, Sline_number_at_pos,
+       0, 2, 0,
+       doc: /* Return buffer line number at position POS.
+If POS is nil, use current buffer location.
+
+If ABSOLUTE is nil, the default, counting starts
+at (point-min), so the value refers to the contents of the
+accessible portion of the (potentially narrowed) buffer.  If
+ABSOLUTE is non-nil, ignore any narrowing and return the
+absolute line number.  */)
+  (Lisp_Object pos, Lisp_Object absolute)
+{
+  ptrdiff_t beg = NILP (absolute) ? BEGV : BEG;
+  ptrdiff_t end = NILP (absolute) ? ZV : Z;
+  ptrdiff_t charpos;
+
+  if (NILP (pos))
+    charpos = PT;
+  else
+    {
+      CHECK_NUMBER_COERCE_MARKER (pos);
+      charpos = clip_to_bounds (beg, XINT (pos), end);
+    }
+
+  return make_number (buf_count_newlines (current_buffer,
+					  CHAR_TO_BYTE (beg),
+					  CHAR_TO_BYTE (charpos))
+		      + 1);
+}
+
 void
 syms_of_fns (void)
 {
@@ -3118,6 +3230,8 @@ compilation.  */);
 
   staticpro (&string_char_byte_cache_string);
   string_char_byte_cache_string = Qnil;
+  staticpro (&string_bytechar_index_string);
+  string_bytechar_index_string = Qnil;
 
   Fset (Qyes_or_no_p_history, Qnil);
 
@@ -3183,4 +3297,5 @@ this variable.  */);
   defsubr (&Swidget_apply);
   defsubr (&Ssecure_hash_algorithms);
   defsubr (&Slocale_info);
+  defsubr (&Sline_number_at_pos);
 }
@@ -82,6 +82,542 @@ check_markers (void)
 
 #endif /* MARKER_DEBUG */
 
+/* Characters between successive entries of a bytechar_index.  */
+
+enum { BYTECHAR_INDEX_INTERVAL = 4096 };
+
+/* Return the character and byte positions of entry I of IDX.  */
+
+static ptrdiff_t
+bytechar_entry_charpos (struct bytechar_index *idx, ptrdiff_t i)
+{
+  return (idx->entries[i].charpos
+	  + (i < idx->shift_from ? 0 : idx->shift_chars));
+}
+
+static ptrdiff_t
+bytechar_entry_bytepos (struct bytechar_index *idx, ptrdiff_t i)
+{
+  return (idx->entries[i].bytepos
+	  + (i < idx->shift_from ? 0 : idx->shift_bytes));
+}
+
+/* Return the number of entries of IDX at or before POS, a byte
+   position if BY_BYTE, else a character position.  */
+
+static ptrdiff_t
+bytechar_index_search (struct bytechar_index *idx, ptrdiff_t pos,
+		       bool by_byte)
+{
+  ptrdiff_t lo = 0, hi = idx->nentries;
+
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      ptrdiff_t p = (by_byte
+		     ? bytechar_entry_bytepos (idx, mid)
+		     : bytechar_entry_charpos (idx, mid));
+      if (p <= pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Apply the pending shift of IDX to its entries.  */
+
+static void
+flush_bytechar_index (struct bytechar_index *idx)
+{
+  if (idx->shift_chars || idx->shift_bytes)
+    for (ptrdiff_t i = idx->shift_from; i < idx->nentries; i++)
+      {
+	idx->entries[i].charpos += idx->shift_chars;
+	idx->entries[i].bytepos += idx->shift_bytes;
+      }
+  idx->shift_from = idx->shift_chars = idx->shift_bytes = 0;
+}
+
+/* Update the index of the current buffer for the replacement of
+   OLD_CHARS characters (OLD_BYTES bytes) at FROM by NEW_CHARS
+   characters (NEW_BYTES bytes).  Entries up to FROM stay as they are,
+   those inside the old text are dropped, and the rest are moved.  */
+
+static void
+adjust_bytechar_index (ptrdiff_t from, ptrdiff_t old_chars,
+		       ptrdiff_t old_bytes, ptrdiff_t new_chars,
+		       ptrdiff_t new_bytes)
+{
+  struct bytechar_index *idx = current_buffer->text->bytechar_index;
+
+  if (!idx)
+    return;
+
+  ptrdiff_t k = bytechar_index_search (idx, from, false);
+  ptrdiff_t m = (old_chars
+		 ? bytechar_index_search (idx, from + old_chars - 1, false)
+		 : k);
+
+  /* Moving the entries from K on is deferred, and merged with the
+     pending move if that also starts at K, as it does for successive
+     edits at one place.  */
+  if (idx->shift_from != k)
+    flush_bytechar_index (idx);
+
+  if (k < m)
+    {
+      memmove (idx->entries + k, idx->entries + m,
+	       (idx->nentries - m) * sizeof *idx->entries);
+      idx->nentries -= m - k;
+    }
+
+  idx->shift_from = k;
+  idx->shift_chars += new_chars - old_chars;
+  idx->shift_bytes += new_bytes - old_bytes;
+}
+
+/* Forget the entries of B's index after character position CHARPOS,
+   whose byte positions may no longer be right.  */
+
+void
+truncate_bytechar_index (struct buffer *b, ptrdiff_t charpos)
+{
+  struct bytechar_index *idx = b->text->bytechar_index;
+
+  if (idx)
+    {
+      flush_bytechar_index (idx);
+      idx->nentries = bytechar_index_search (idx, charpos, false);
+    }
+}
+
+/* Free the index of B's text.  */
+
+void
+free_bytechar_index (struct buffer *b)
+{
+  struct bytechar_index *idx = b->text->bytechar_index;
+
+  if (idx)
+    {
+      xfree (idx->entries);
+      xfree (idx);
+      b->text->bytechar_index = NULL;
+    }
+}
+
+/* Store in *CHARPOS and *BYTEPOS the last position known to B's index
+   at or before POS, a byte position if BY_BYTE and a character
+   position otherwise.  First extend the index towards POS, so that
+   the result is less than BYTECHAR_INDEX_INTERVAL characters away.
+   This scans the text past the last entry once; later lookups in the
+   same part of the buffer take logarithmic time.  */
+
+void
+buf_bytechar_index_find (struct buffer *b, ptrdiff_t pos, bool by_byte,
+			 ptrdiff_t *charpos, ptrdiff_t *bytepos)
+{
+  struct bytechar_index *idx = b->text->bytechar_index;
+
+  if (!idx)
+    idx = b->text->bytechar_index = xzalloc (sizeof *idx);
+
+  ptrdiff_t n = idx->nentries;
+  ptrdiff_t c = n ? bytechar_entry_charpos (idx, n - 1) : BUF_BEG (b);
+  ptrdiff_t c_byte = (n ? bytechar_entry_bytepos (idx, n - 1)
+		      : BUF_BEG_BYTE (b));
+
+  if ((by_byte ? c_byte : c) + BYTECHAR_INDEX_INTERVAL <= pos)
+    {
+      flush_bytechar_index (idx);
+      while ((by_byte ? c_byte : c) + BYTECHAR_INDEX_INTERVAL <= pos
+	     && c + BYTECHAR_INDEX_INTERVAL <= BUF_Z (b))
+	{
+	  for (int i = 0; i < BYTECHAR_INDEX_INTERVAL; i++)
+	    BUF_INC_POS (b, c_byte);
+	  c += BYTECHAR_INDEX_INTERVAL;
+
+	  if (idx->nentries == idx->size)
+	    idx->entries = xpalloc (idx->entries, &idx->size, 1, -1,
+				    sizeof *idx->entries);
+	  idx->entries[idx->nentries].charpos = c;
+	  idx->entries[idx->nentries].bytepos = c_byte;
+	  idx->nentries++;
+	}
+    }
+
+  n = bytechar_index_search (idx, pos, by_byte);
+  if (n)
+    {
+      *charpos = bytechar_entry_charpos (idx, n - 1);
+      *bytepos = bytechar_entry_bytepos (idx, n - 1);
+    }
+  else
+    {
+      *charpos = BUF_BEG (b);
+      *bytepos = BUF_BEG_BYTE (b);
+    }
+}
+
+/* Bytes per block of a freshly built line_index.  Blocks that edits
+   grow past LINE_INDEX_BLOCK_MAX, or too many emptied blocks, make
+   the index be rebuilt.  */
+
+enum { LINE_INDEX_BLOCK = 16 * 1024,
+       LINE_INDEX_BLOCK_MAX = 16 * LINE_INDEX_BLOCK };
+
+/* Spans shorter than LINE_INDEX_MIN_SPAN, a few blocks, are counted
+   by scanning them directly.  */
+
+verify (LINE_INDEX_MIN_SPAN == 4 * LINE_INDEX_BLOCK);
+
+/* Add DELTA to element I of the Fenwick tree TREE of N elements.  */
+
+static void
+fenwick_add (ptrdiff_t *tree, ptrdiff_t n, ptrdiff_t i, ptrdiff_t delta)
+{
+  for (; i <= n; i += i & -i)
+    tree[i] += delta;
+}
+
+/* Return the sum of the first I elements of TREE.  */
+
+static ptrdiff_t
+fenwick_sum (ptrdiff_t *tree, ptrdiff_t i)
+{
+  ptrdiff_t sum = 0;
+  for (; 0 < i; i -= i & -i)
+    sum += tree[i];
+  return sum;
+}
+
+static ptrdiff_t
+fenwick_get (ptrdiff_t *tree, ptrdiff_t i)
+{
+  return fenwick_sum (tree, i) - fenwick_sum (tree, i - 1);
+}
+
+/* Return the least I such that the first I elements of TREE, which
+   are nonnegative, add up to more than VALUE; N + 1 if there is no
+   such I.  */
+
+static ptrdiff_t
+fenwick_search (ptrdiff_t *tree, ptrdiff_t n, ptrdiff_t value)
+{
+  ptrdiff_t i = 0, step = 1;
+
+  while (step <= n / 2)
+    step *= 2;
+  for (; step; step /= 2)
+    if (i + step <= n && tree[i + step] <= value)
+      {
+	i += step;
+	value -= tree[i];
+      }
+  return i + 1;
+}
+
+/* Return the number of newlines in B's text from byte position FROM
+   to TO.  */
+
+static ptrdiff_t
+scan_count_newlines (struct buffer *b, ptrdiff_t from, ptrdiff_t to)
+{
+  ptrdiff_t n = 0;
+
+  while (from < to)
+    {
+      ptrdiff_t end = (from < BUF_GPT_BYTE (b)
+		       ? min (to, BUF_GPT_BYTE (b)) : to);
+      unsigned char *p = BUF_BYTE_ADDRESS (b, from);
+      unsigned char *lim = p + (end - from);
+
+      while ((p = memchr (p, '\n', lim - p)))
+	{
+	  p++;
+	  n++;
+	}
+      from = end;
+    }
+  return n;
+}
+
+/* Return the byte position after the Nth newline in B's text from
+   byte position FROM to TO, or 0 if there are fewer.  */
+
+static ptrdiff_t
+scan_nth_newline (struct buffer *b, ptrdiff_t from, ptrdiff_t to,
+		  ptrdiff_t n)
+{
+  while (from < to)
+    {
+      ptrdiff_t end = (from < BUF_GPT_BYTE (b)
+		       ? min (to, BUF_GPT_BYTE (b)) : to);
+      unsigned char *base = BUF_BYTE_ADDRESS (b, from);
+      unsigned char *p = base, *lim = base + (end - from);
+
+      while ((p = memchr (p, '\n', lim - p)))
+	{
+	  p++;
+	  if (--n == 0)
+	    return from + (p - base);
+	}
+      from = end;
+    }
+  return 0;
+}
+
+/* Free the line index of B's text.  */
+
+void
+free_line_index (struct buffer *b)
+{
+  struct line_index *idx = b->text->line_index;
+
+  if (idx)
+    {
+      xfree (idx->bytes);
+      xfree (idx->newlines);
+      xfree (idx);
+      b->text->line_index = NULL;
+    }
+}
+
+/* Return a new line index of B's text.  */
+
+static struct line_index *
+build_line_index (struct buffer *b)
+{
+  struct line_index *idx = xzalloc (sizeof *idx);
+  ptrdiff_t total = BUF_Z_BYTE (b) - BUF_BEG_BYTE (b);
+  ptrdiff_t n = total / LINE_INDEX_BLOCK + 1;
+
+  idx->nblocks = n;
+  idx->total_bytes = total;
+  idx->bytes = xnmalloc (n + 1, sizeof *idx->bytes);
+  idx->newlines = xnmalloc (n + 1, sizeof *idx->newlines);
+  idx->bytes[0] = idx->newlines[0] = 0;
+  for (ptrdiff_t i = 1; i <= n; i++)
+    {
+      ptrdiff_t from = BUF_BEG_BYTE (b) + (i - 1) * LINE_INDEX_BLOCK;
+      ptrdiff_t to = min (from + LINE_INDEX_BLOCK, BUF_Z_BYTE (b));
+      idx->bytes[i] = to - from;
+      idx->newlines[i] = scan_count_newlines (b, from, to);
+    }
+
+  /* Turn the block values into Fenwick trees in place.  */
+  for (ptrdiff_t i = 1; i <= n; i++)
+    {
+      ptrdiff_t parent = i + (i & -i);
+      if (parent <= n)
+	{
+	  idx->bytes[parent] += idx->bytes[i];
+	  idx->newlines[parent] += idx->newlines[i];
+	}
+    }
+  return idx;
+}
+
+/* Note that block I of the current buffer's line index must be
+   recounted.  If too many blocks are pending, drop the index
+   instead.  */
+
+static void
+line_index_dirty (struct line_index *idx, ptrdiff_t i)
+{
+  for (int j = 0; j < idx->ndirty; j++)
+    if (idx->dirty[j] == i)
+      return;
+  if (idx->ndirty == LINE_INDEX_DIRTY_MAX)
+    free_line_index (current_buffer);
+  else
+    idx->dirty[idx->ndirty++] = i;
+}
+
+/* Update the line index of the current buffer for the replacement of
+   OLD_BYTES bytes at byte position FROM_BYTE by NEW_BYTES bytes.  Blocks
+   wholly inside the old text become empty; the newlines of the blocks
+   that are only partly changed are recounted later.  */
+
+static void
+adjust_line_index (ptrdiff_t from_byte, ptrdiff_t old_bytes,
+		   ptrdiff_t new_bytes)
+{
+  struct line_index *idx = current_buffer->text->line_index;
+
+  if (!idx)
+    return;
+
+  ptrdiff_t n = idx->nblocks;
+  ptrdiff_t from = from_byte - BEG_BYTE, to = from + old_bytes;
+
+  idx->total_bytes += new_bytes - old_bytes;
+
+  if (from < to)
+    {
+      ptrdiff_t i = fenwick_search (idx->bytes, n, from);
+      ptrdiff_t start = fenwick_sum (idx->bytes, i - 1);
+
+      for (; start < to && i <= n; i++)
+	{
+	  ptrdiff_t len = fenwick_get (idx->bytes, i);
+	  ptrdiff_t lo = max (from, start), hi = min (to, start + len);
+
+	  if (lo == start && hi == start + len)
+	    fenwick_add (idx->newlines, n, i,
+			 - fenwick_get (idx->newlines, i));
+	  else
+	    {
+	      line_index_dirty (idx, i);
+	      if (!current_buffer->text->line_index)
+		return;
+	    }
+	  fenwick_add (idx->bytes, n, i, lo - hi);
+	  start += len;
+	}
+    }
+
+  if (new_bytes)
+    {
+      ptrdiff_t i = min (fenwick_search (idx->bytes, n, from), n);
+      fenwick_add (idx->bytes, n, i, new_bytes);
+      line_index_dirty (idx, i);
+    }
+}
+
+/* Note that the text of the current buffer between character positions
+   START and END has been changed in place.  */
+
+static void
+line_index_modified (ptrdiff_t start, ptrdiff_t end)
+{
+  struct line_index *idx = current_buffer->text->line_index;
+
+  if (!idx)
+    return;
+
+  ptrdiff_t from = CHAR_TO_BYTE (start) - BEG_BYTE;
+  ptrdiff_t to = CHAR_TO_BYTE (end) - BEG_BYTE;
+  ptrdiff_t i = fenwick_search (idx->bytes, idx->nblocks, from);
+  ptrdiff_t start_byte = fenwick_sum (idx->bytes, i - 1);
+
+  for (; start_byte < to && i <= idx->nblocks; i++)
+    {
+      ptrdiff_t len = fenwick_get (idx->bytes, i);
+      if (len)
+	{
+	  line_index_dirty (idx, i);
+	  if (!current_buffer->text->line_index)
+	    return;
+	}
+      start_byte += len;
+    }
+}
+
+/* Return the line index of B's text, brought up to date.  */
+
+static struct line_index *
+current_line_index (struct buffer *b)
+{
+  struct line_index *idx = b->text->line_index;
+
+  if (idx
+      && (idx->total_bytes != BUF_Z_BYTE (b) - BUF_BEG_BYTE (b)
+	  || idx->nblocks > 4 * (idx->total_bytes / LINE_INDEX_BLOCK + 1)))
+    free_line_index (b);
+
+  idx = b->text->line_index;
+  if (idx)
+    {
+      ptrdiff_t n = idx->nblocks;
+
+      for (int j = 0; j < idx->ndirty; j++)
+	{
+	  ptrdiff_t i = idx->dirty[j];
+	  ptrdiff_t start = fenwick_sum (idx->bytes, i - 1);
+	  ptrdiff_t len = fenwick_get (idx->bytes, i);
+
+	  if (LINE_INDEX_BLOCK_MAX < len)
+	    {
+	      free_line_index (b);
+	      break;
+	    }
+	  ptrdiff_t from = BUF_BEG_BYTE (b) + start;
+	  fenwick_add (idx->newlines, n, i,
+		       (scan_count_newlines (b, from, from + len)
+			- fenwick_get (idx->newlines, i)));
+	}
+    }
+
+  idx = b->text->line_index;
+  if (idx)
+    idx->ndirty = 0;
+  else
+    idx = b->text->line_index = build_line_index (b);
+  return idx;
+}
+
+/* Return the number of newlines in B's text before byte position POS,
+   using IDX.  */
+
+static ptrdiff_t
+line_index_newlines_before (struct buffer *b, struct line_index *idx,
+			    ptrdiff_t pos)
+{
+  ptrdiff_t n = idx->nblocks;
+  ptrdiff_t p = pos - BUF_BEG_BYTE (b);
+  ptrdiff_t i = fenwick_search (idx->bytes, n, p);
+
+  if (n < i)
+    return fenwick_sum (idx->newlines, n);
+
+  ptrdiff_t start = fenwick_sum (idx->bytes, i - 1);
+  ptrdiff_t end = start + fenwick_get (idx->bytes, i);
+  ptrdiff_t before = fenwick_sum (idx->newlines, i - 1);
+
+  /* Scan the shorter part of the block.  */
+  if (p - start <= end - p)
+    return before + scan_count_newlines (b, BUF_BEG_BYTE (b) + start, pos);
+  else
+    return (before + fenwick_get (idx->newlines, i)
+	    - scan_count_newlines (b, pos, BUF_BEG_BYTE (b) + end));
+}
+
+/* Return the number of newlines in B's text from byte position
+   FROM_BYTE to TO_BYTE.  Long spans are counted with the line index,
+   which is built on first use.  */
+
+ptrdiff_t
+buf_count_newlines (struct buffer *b, ptrdiff_t from_byte, ptrdiff_t to_byte)
+{
+  if (to_byte - from_byte < LINE_INDEX_MIN_SPAN)
+    return scan_count_newlines (b, from_byte, to_byte);
+
+  struct line_index *idx = current_line_index (b);
+  return (line_index_newlines_before (b, idx, to_byte)
+	  - line_index_newlines_before (b, idx, from_byte));
+}
+
+/* Return the byte position after the Nth newline of B's text, counting
+   from 1, or 0 if the text has fewer than N newlines.  */
+
+ptrdiff_t
+buf_newline_position (struct buffer *b, ptrdiff_t n)
+{
+  eassert (0 < n);
+
+  struct line_index *idx = current_line_index (b);
+  ptrdiff_t i = fenwick_search (idx->newlines, idx->nblocks, n - 1);
+
+  if (idx->nblocks < i)
+    return 0;
+
+  ptrdiff_t start = BUF_BEG_BYTE (b) + fenwick_sum (idx->bytes, i - 1);
+  return scan_nth_newline (b, start, start + fenwick_get (idx->bytes, i),
+			   n - fenwick_sum (idx->newlines, i - 1));
+}
+
 /* Move gap to byte position BYTEPOS, which is also char position CHARPOS.
    Note that this can quit!  */
 
@@ -241,6 +777,8 @@ adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t charpos;
 
   adjust_suspend_auto_hscroll (from, to);
+  adjust_bytechar_index (from, to - from, to_byte - from_byte, 0, 0);
+  adjust_line_index (from_byte, to_byte - from_byte, 0);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       charpos = m->charpos;
@@ -281,6 +819,8 @@ adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t nbytes = to_byte - from_byte;
 
   adjust_suspend_auto_hscroll (from, to);
+  adjust_bytechar_index (from, 0, 0, nchars, nbytes);
+  adjust_line_index (from_byte, 0, nbytes);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       eassert (m->bytepos >= m->charpos
@@ -347,6 +887,8 @@ adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
   ptrdiff_t diff_bytes = new_bytes - old_bytes;
 
   adjust_suspend_auto_hscroll (from, from + old_chars);
+  adjust_bytechar_index (from, old_chars, old_bytes, new_chars, new_bytes);
+  adjust_line_index (from_byte, old_bytes, new_bytes);
   for (m = BUF_MARKERS (current_buffer); m; m = m->next)
     {
       if (m->bytepos >= prev_to_byte)
@@ -434,6 +976,9 @@ adjust_markers_bytepos (ptrdiff_t from, ptrdiff_t from_byte,
 
   /* Make sure cached charpos/bytepos is invalid.  */
   clear_charpos_cache (current_buffer);
+  truncate_bytechar_index (current_buffer, from);
+  /* The old byte length of the changed text is not known here.  */
+  free_line_index (current_buffer);
 }
 
 
@@ -458,8 +1003,14 @@ make_gap_larger (ptrdiff_t nbytes_added)
     buffer_overflow ();
 
   /* If we have to get more space, get enough to last a while;
-     but do not exceed the maximum buffer size.  */
-  nbytes_added = min (nbytes_added + GAP_BYTES_DFL,
+     but do not exceed the maximum buffer size.  Reserving in
+     proportion to the current size means a buffer that grows by many
+     small insertions is reallocated, and possibly copied, only a
+     logarithmic number of times instead of once per GAP_BYTES_DFL.  */
+  ptrdiff_t reserve = clip_to_bounds (GAP_BYTES_DFL,
+				      current_size / GAP_GROWTH_DIVISOR,
+				      GAP_BYTES_GROWTH_MAX);
+  nbytes_added = min (nbytes_added + reserve,
 		      BUF_BYTES_MAX - current_size);
 
   enlarge_buffer_text (current_buffer, nbytes_added);
@@ -1879,6 +2430,7 @@ void
 modify_text (ptrdiff_t start, ptrdiff_t end)
 {
   prepare_to_modify_buffer (start, end, NULL);
+  line_index_modified (start, end);
 
   BUF_COMPUTE_UNCHANGED (current_buffer, start - 1, end);
   if (MODIFF <= SAVE_MODIFF)
@@ -2178,15 +2178,62 @@ get_local_map (ptrdiff_t position, struct buffer *buffer, Lisp_Object type)
     return BVAR (buffer, keymap);
 }
 
+/* State of copy_interval_run: the next interval to copy, how much of
+   its beginning to skip, and how much text is left to copy.  */
+
+struct interval_copy
+{
+  INTERVAL source;
+  ptrdiff_t skip, remaining;
+};
+
+/* Return a balanced tree of copies of the next N intervals of C.  The
+   copies are made in text order, so that each node is created between
+   its left and right subtrees.  */
+
+static INTERVAL
+copy_interval_run (struct interval_copy *c, ptrdiff_t n)
+{
+  if (n == 0)
+    return NULL;
+
+  INTERVAL left = copy_interval_run (c, n / 2);
+  INTERVAL new = make_interval ();
+  ptrdiff_t len = min (LENGTH (c->source) - c->skip, c->remaining);
+
+  copy_properties (c->source, new);
+  c->remaining -= len;
+  c->skip = 0;
+  c->source = next_interval (c->source);
+
+  INTERVAL right = copy_interval_run (c, n - n / 2 - 1);
+
+  new->total_length = len + TOTAL_LENGTH (left) + TOTAL_LENGTH (right);
+  if (left)
+    {
+      set_interval_left (new, left);
+      set_interval_parent (left, new);
+    }
+  if (right)
+    {
+      set_interval_right (new, right);
+      set_interval_parent (right, new);
+    }
+  return new;
+}
+
 /* Produce an interval tree reflecting the intervals in
    TREE from START to START + LENGTH.
-   The new interval tree has no parent and has a starting-position of 0.  */
+   The new interval tree has no parent and has a starting-position of 0.
+   It is built balanced, rather than by splitting off one interval after
+   another and rebalancing, since large propertized regions can have
+   very many intervals.  */
 
 INTERVAL
 copy_intervals (INTERVAL tree, ptrdiff_t start, ptrdiff_t length)
 {
-  register INTERVAL i, new, t;
-  register ptrdiff_t got, prevlen;
+  INTERVAL i, j;
+  ptrdiff_t got, n;
 
   if (!tree || length <= 0)
     return NULL;
@@ -2199,25 +2246,19 @@ copy_intervals (INTERVAL tree, ptrdiff_t start, ptrdiff_t length)
       && DEFAULT_INTERVAL_P (i))
     return NULL;
 
-  new = make_interval ();
-  new->position = 0;
-  got = (LENGTH (i) - (start - i->position));
-  new->total_length = length;
-  eassert (TOTAL_LENGTH (new) >= 0);
-  copy_properties (i, new);
-
-  t = new;
-  prevlen = got;
-  while (got < length)
+  /* Count the intervals to copy.  */
+  got = LENGTH (i) - (start - i->position);
+  for (n = 1, j = i; got < length; n++)
     {
-      i = next_interval (i);
-      t = split_interval_right (t, prevlen);
-      copy_properties (i, t);
-      prevlen = LENGTH (i);
-      got += prevlen;
+      j = next_interval (j);
+      got += LENGTH (j);
     }
 
-  return balance_an_interval (new);
+  struct interval_copy c = { i, start - i->position, length };
+  INTERVAL new = copy_interval_run (&c, n);
+  eassert (c.remaining == 0 && TOTAL_LENGTH (new) == length);
+  new->position = 0;
+  return new;
 }
 
 /* Give STRING the properties of BUFFER from POSITION to LENGTH.  */
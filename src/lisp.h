@@ -3587,6 +3587,16 @@ extern void move_gap_both (ptrdiff_t, ptrdiff_t);
 extern _Noreturn void buffer_overflow (void);
 extern void make_gap (ptrdiff_t);
 extern void make_gap_1 (struct buffer *, ptrdiff_t);
+extern void buf_bytechar_index_find (struct buffer *, ptrdiff_t, bool,
+				     ptrdiff_t *, ptrdiff_t *);
+extern void truncate_bytechar_index (struct buffer *, ptrdiff_t);
+extern void free_bytechar_index (struct buffer *);
+/* buf_count_newlines counts spans shorter than this many bytes by
+   scanning them, without the line index.  */
+enum { LINE_INDEX_MIN_SPAN = 64 * 1024 };
+extern ptrdiff_t buf_count_newlines (struct buffer *, ptrdiff_t, ptrdiff_t);
+extern ptrdiff_t buf_newline_position (struct buffer *, ptrdiff_t);
+extern void free_line_index (struct buffer *);
 extern ptrdiff_t copy_text (const unsigned char *, unsigned char *,
 			    ptrdiff_t, bool, bool);
 extern int count_combining_before (const unsigned char *,
@@ -3704,6 +3714,7 @@ extern const char *pending_malloc_warning;
 extern Lisp_Object zero_vector;
 extern EMACS_INT consing_since_gc;
 extern EMACS_INT gc_relative_threshold;
+extern EMACS_INT gc_adaptive_trigger;
 extern EMACS_INT memory_full_cons_threshold;
 extern Lisp_Object list1 (Lisp_Object);
 extern Lisp_Object list2 (Lisp_Object, Lisp_Object);
@@ -3715,6 +3726,8 @@ enum constype {CONSTYPE_HEAP, CONSTYPE_PURE};
 extern Lisp_Object listn (enum constype, ptrdiff_t, Lisp_Object, ...);
 extern Lisp_Object build_marker (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern Lisp_Object bounded_number(EMACS_INT);
+extern void maybe_gc_when_idle (void);
+extern void maybe_gc_adaptive (void);
 
 /* Build a frequently used 2/3/4-integer lists.  */
 
@@ -4181,6 +4194,7 @@ extern void syms_of_fileio (void);
 
 /* Defined in search.c.  */
 extern void shrink_regexp_cache (void);
+extern void mark_regexp_cache (void);
 extern void restore_search_regs (void);
 extern void update_search_regs (ptrdiff_t oldstart,
                                 ptrdiff_t oldend, ptrdiff_t newend);
@@ -4594,6 +4608,19 @@ extern bool profiler_memory_running;
 extern Lisp_Object memory_log;
 extern Lisp_Object make_log (EMACS_INT heap_size, EMACS_INT max_stack_depth);
 extern void malloc_probe (size_t);
+/* Lisp object types accounted separately by the memory profiler.  */
+enum alloc_probe_type
+  {
+    ALLOC_PROBE_CONS,
+    ALLOC_PROBE_FLOAT,
+    ALLOC_PROBE_STRING,
+    ALLOC_PROBE_VECTOR,
+    ALLOC_PROBE_HASH_TABLE,
+    ALLOC_PROBE_MISC,
+    ALLOC_PROBE_TYPES
+  };
+extern void alloc_probe (enum alloc_probe_type, size_t);
+extern void setup_alloc_logs (void);
 extern void syms_of_profiler (void);
 
 
@@ -4891,10 +4918,15 @@ struct for_each_tail_internal
 INLINE void
 maybe_gc (void)
 {
-  if ((consing_since_gc > gc_cons_threshold
-       && consing_since_gc > gc_relative_threshold)
-      || (!NILP (Vmemory_full)
-	  && consing_since_gc > memory_full_cons_threshold))
+  if (0 < gc_adaptive_trigger && NILP (Vmemory_full))
+    {
+      if (consing_since_gc > gc_adaptive_trigger)
+	maybe_gc_adaptive ();
+    }
+  else if ((consing_since_gc > gc_cons_threshold
+	    && consing_since_gc > gc_relative_threshold)
+	   || (!NILP (Vmemory_full)
+	       && consing_since_gc > memory_full_cons_threshold))
     Fgarbage_collect ();
 }
 
@@ -447,6 +447,86 @@ malloc_probe (size_t size)
   record_backtrace (XHASH_TABLE (memory_log), min (size, MOST_POSITIVE_FIXNUM));
 }
 
+/* Per-type allocation logs: a vector of ALLOC_PROBE_TYPES logs while
+   the memory profiler is running, nil otherwise.  */
+static Lisp_Object alloc_logs;
+
+/* Total bytes allocated for each type since the logs were set up.  */
+static EMACS_INT alloc_bytes[ALLOC_PROBE_TYPES];
+
+/* Bytes allocated for each type since its last recorded sample.  */
+static EMACS_INT alloc_unsampled[ALLOC_PROBE_TYPES];
+
+/* Create the per-type allocation logs if they don't exist yet, and
+   reset the counters that go with them.  */
+void
+setup_alloc_logs (void)
+{
+  if (NILP (alloc_logs))
+    {
+      /* Build the vector before publishing it, so that the allocations
+	 made here are not themselves probed into half-built logs.  */
+      Lisp_Object logs = Fmake_vector (make_number (ALLOC_PROBE_TYPES), Qnil);
+      for (int i = 0; i < ALLOC_PROBE_TYPES; i++)
+	ASET (logs, i, make_log (profiler_log_size, profiler_max_stack_depth));
+      memset (alloc_bytes, 0, sizeof alloc_bytes);
+      memset (alloc_unsampled, 0, sizeof alloc_unsampled);
+      alloc_logs = logs;
+    }
+}
+
+/* Record that the current backtrace allocated a Lisp object of TYPE
+   taking SIZE bytes.  Every type is counted exactly, but a backtrace
+   is only recorded once `profiler-alloc-sampling-interval' bytes of
+   that type have accumulated; the sample carries all of them.  */
+void
+alloc_probe (enum alloc_probe_type type, size_t size)
+{
+  EMACS_INT nbytes = min (size, MOST_POSITIVE_FIXNUM);
+  alloc_bytes[type] = saturated_add (alloc_bytes[type], nbytes);
+  if (!VECTORP (alloc_logs))
+    return;
+  alloc_unsampled[type] = saturated_add (alloc_unsampled[type], nbytes);
+  if (alloc_unsampled[type] >= profiler_alloc_sampling_interval)
+    {
+      record_backtrace (XHASH_TABLE (AREF (alloc_logs, type)),
+			alloc_unsampled[type]);
+      alloc_unsampled[type] = 0;
+    }
+}
+
+DEFUN ("profiler-memory-type-log", Fprofiler_memory_type_log,
+       Sprofiler_memory_type_log, 0, 0, 0,
+       doc: /* Return the per-type memory profiler logs.
+The value is a list of entries (TYPE BYTES LOG), one per Lisp object
+type: `conses', `floats', `strings', `vectors', `hash-tables' and
+`miscs'.  BYTES is the total number of bytes allocated for objects of
+that TYPE, and LOG is a hash-table mapping backtraces to the bytes
+allocated at those points, in the same format as `profiler-memory-log'.
+Before returning, new logs are allocated for future samples.
+Return nil if the memory profiler has not been started.  */)
+  (void)
+{
+  Lisp_Object const type_names[ALLOC_PROBE_TYPES] =
+    { Qconses, Qfloats, Qstrings, Qvectors, Qhash_tables, Qmiscs };
+  Lisp_Object logs = alloc_logs;
+  Lisp_Object result = Qnil;
+
+  if (NILP (logs))
+    return Qnil;
+
+  /* The logs become visible to Elisp here, so stop recording into
+     them before consing up the result.  */
+  alloc_logs = Qnil;
+  for (int i = ALLOC_PROBE_TYPES - 1; i >= 0; i--)
+    result = Fcons (list3 (type_names[i], make_number (alloc_bytes[i]),
+			   AREF (logs, i)),
+		    result);
+  if (profiler_memory_running)
+    setup_alloc_logs ();
+  return result;
+}
+
 DEFUN ("function-equal", Ffunction_equal, Sfunction_equal, 2, 2, 0,
        doc: /* Return non-nil if F1 and F2 come from the same source.
 Used to determine if different closures are just different instances of
@@ -518,6 +598,15 @@ syms_of_profiler (void)
 If the log gets full, some of the least-seen call-stacks will be evicted
 to make room for new entries.  */);
   profiler_log_size = 10000;
+  DEFVAR_INT ("profiler-alloc-sampling-interval",
+	      profiler_alloc_sampling_interval,
+	      doc: /* Bytes of one object type allocated between backtrace samples.
+The memory profiler records a backtrace in the log of an object type
+once this many bytes of objects of that type have been allocated
+since its last sample.  See `profiler-memory-type-log'.  */);
+  profiler_alloc_sampling_interval = 4096;
+
+  DEFSYM (Qhash_tables, "hash-tables");
 
   DEFSYM (Qprofiler_backtrace_equal, "profiler-backtrace-equal");
 
@@ -541,4 +630,7 @@ to make room for new entries.  */);
   profiler_memory_running = false;
   memory_log = Qnil;
   staticpro (&memory_log);
+  alloc_logs = Qnil;
+  staticpro (&alloc_logs);
+  defsubr (&Sprofiler_memory_type_log);
 }
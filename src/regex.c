@@ -529,6 +529,12 @@ static regoff_t re_match_2_internal (struct re_pattern_buffer *bufp,
 				     ssize_t pos,
 				     struct re_registers *regs,
 				     ssize_t stop);
+static bool re_nfa_2 (struct re_pattern_buffer *bufp,
+		      re_char *string1, size_t size1,
+		      re_char *string2, size_t size2,
+		      ssize_t startpos, ssize_t range,
+		      struct re_registers *regs, ssize_t stop,
+		      bool search, regoff_t *result);
 
 /* These are the command codes that appear in compiled regular
    expressions.  Some opcodes are followed by argument bytes.  A
@@ -2501,6 +2507,9 @@ regex_compile (re_char *pattern, size_t size,
   bufp->fastmap_accurate = 0;
   bufp->not_bol = bufp->not_eol = 0;
   bufp->used_syntax = 0;
+  bufp->nfa_checked = 0;
+  free (bufp->nfa_prog);
+  bufp->nfa_prog = NULL;
 
   /* Set `used' to zero, so that if we return an error, the pattern
      printer (for debugging) will think there's no pattern.  We reset it
@@ -4111,8 +4120,8 @@ analyze_first (re_char *p, re_char *pend, char *fastmap,
    The caller must supply the address of a (1 << BYTEWIDTH)-byte data
    area as BUFP->fastmap.
 
-   We set the `fastmap', `fastmap_accurate', and `can_be_null' fields in
-   the pattern buffer.
+   We set the `fastmap', `fastmap_accurate', `can_be_null', `prefix' and
+   `prefix_size' fields in the pattern buffer.
 
    Returns 0 if we succeed, -2 if an internal error.   */
 
@@ -4130,6 +4139,21 @@ re_compile_fastmap (struct re_pattern_buffer *bufp)
   analysis = analyze_first (bufp->buffer, bufp->buffer + bufp->used,
 			    fastmap, RE_MULTIBYTE_P (bufp));
   bufp->can_be_null = (analysis != 0);
+
+  /* If the pattern starts with a string, that is what a match starts
+     with.  */
+  {
+    re_char *p = bufp->buffer, *pend = p + bufp->used;
+
+    while (p < pend && (re_opcode_t) *p == start_memory)
+      p += 2;
+    bufp->prefix_size = 0;
+    if (p < pend && (re_opcode_t) *p == exactn)
+      {
+	bufp->prefix = p + 2 - bufp->buffer;
+	bufp->prefix_size = p[1];
+      }
+  }
   return 0;
 } /* re_compile_fastmap */
 
@@ -4179,6 +4203,39 @@ re_search (struct re_pattern_buffer *bufp, const char *string, size_t size,
 }
 WEAK_ALIAS (__re_search, re_search)
 
+/* Skip forward from D to the first place where the PREFIX_SIZE bytes
+   at PREFIX start, looking for the first of them with memchr and
+   moving at most *RANGE - LIM bytes.  DEND is the end of the string D
+   is in; a candidate too close to it for the whole prefix to fit is
+   accepted unchecked, since the prefix may continue in the other
+   string.  Decrease *RANGE by the distance moved and return the new
+   position.  */
+
+static re_char *
+skip_to_prefix (re_char *d, re_char *dend, ssize_t *range, ssize_t lim,
+		re_char *prefix, int prefix_size)
+{
+  while (*range > lim)
+    {
+      re_char *q = memchr (d, prefix[0], *range - lim);
+
+      if (!q)
+	{
+	  d += *range - lim;
+	  *range = lim;
+	  break;
+	}
+      *range -= q - d;
+      d = q;
+      if (dend - d < prefix_size
+	  || !memcmp (d + 1, prefix + 1, prefix_size - 1))
+	break;
+      d++;
+      (*range)--;
+    }
+  return d;
+}
+
 /* Head address of virtual concatenation of string.  */
 #define HEAD_ADDR_VSTRING(P)		\
   (((P) >= size1 ? string2 : string1))
@@ -4223,6 +4280,9 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   boolean anchored_start;
   /* Nonzero if we are searching multibyte string.  */
   const boolean multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  /* Number of bytes every match starts with that can be looked for
+     without decoding characters.  */
+  int prefix_size = 0;
 
   /* Check for out-of-range STARTPOS.  */
   if (startpos < 0 || startpos > total_size)
@@ -4264,6 +4324,23 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   /* See whether the pattern is anchored.  */
   anchored_start = (bufp->buffer[0] == begline);
 
+  /* A prefix can be looked for byte by byte if the pattern and the
+     string encode it alike.  */
+  if (fastmap && !RE_TRANSLATE_P (translate))
+    {
+      re_char *p = bufp->buffer + bufp->prefix;
+      int i;
+
+      prefix_size = bufp->prefix_size;
+      if (RE_MULTIBYTE_P (bufp) != multibyte)
+	for (i = 0; i < prefix_size; i++)
+	  if (! IS_REAL_ASCII (p[i]))
+	    {
+	      prefix_size = 0;
+	      break;
+	    }
+    }
+
 #ifdef emacs
   gl_state.object = re_match_object; /* Used by SYNTAX_TABLE_BYTE_TO_CHAR. */
   {
@@ -4273,6 +4350,10 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
   }
 #endif
 
+  if (re_nfa_2 (bufp, string1, size1, string2, size2, startpos, range,
+		regs, stop, true, &val))
+    return val;
+
   /* Loop through the string, looking for a place to start matching.  */
   for (;;)
     {
@@ -4306,9 +4387,16 @@ re_search_2 (struct re_pattern_buffer *bufp, const char *str1, size_t size1,
 	      if (startpos < size1 && startpos + range >= size1)
 		lim = range - (size1 - startpos);
 
-	      /* Written out as an if-else to avoid testing `translate'
-		 inside the loop.  */
-	      if (RE_TRANSLATE_P (translate))
+	      /* If every match starts with the same bytes, look for them
+		 as skip_to_prefix does.  Otherwise use the fastmap; the
+		 loops are written out as an if-else to avoid testing
+		 `translate' inside the loop.  */
+	      if (prefix_size > 0)
+		d = skip_to_prefix (d, (startpos < size1
+					? string1 + size1 : string2 + size2),
+				    &range, lim, bufp->buffer + bufp->prefix,
+				    prefix_size);
+	      else if (RE_TRANSLATE_P (translate))
 		{
 		  if (multibyte)
 		    while (range > lim)
@@ -4872,6 +4960,879 @@ mutually_exclusive_p (struct re_pattern_buffer *bufp, re_char *p1,
 }
 
 
+/* Matching without backtracking.
+
+   re_match_2_internal tries the alternatives of a pattern one at a
+   time and backs up when one fails, which takes exponential time on
+   patterns such as `\(a*\)*b' and quadratic time on many ordinary
+   ones.  When a pattern uses neither back references, counted
+   repetitions nor syntax-dependent operators, we can instead decode it
+   into the small program below and run all of its alternatives side
+   by side, one character of text at a time.  Each character then costs
+   at most one visit of each instruction, however the pattern is
+   written.  Threads are kept in the order re_match_2_internal would
+   try them, so the match and its registers come out the same.  */
+
+enum nfa_opcode
+{
+  nfa_char,		/* One character of an `exactn'.  */
+  nfa_anychar,
+  nfa_charset,		/* A `charset' or `charset_not'.  */
+  nfa_split,		/* Go on with the next instruction, then with X.  */
+  nfa_loop,		/* Like `nfa_split', but go straight to X when
+			   entered again from the next instruction without
+			   having matched anything, like
+			   `on_failure_jump_loop'.  */
+  nfa_nastyloop,	/* Like `nfa_split', but only go on with the next
+			   instruction when entered again from X without
+			   having matched anything, like
+			   `on_failure_jump_nastyloop'.  */
+  nfa_jump,
+  nfa_start_memory,
+  nfa_stop_memory,
+  nfa_begline,
+  nfa_endline,
+  nfa_begbuf,
+  nfa_endbuf,
+  nfa_succeed
+};
+
+struct nfa_inst
+{
+  unsigned char op;
+
+  /* For `nfa_split', whether it starts a loop that never needs to back
+     up, because its body and what follows it cannot match the same
+     character.  */
+  bool simple;
+
+  /* The instruction to go to, or the register number.  */
+  int x;
+
+  /* The offset in the pattern of the command this was decoded from, or
+     for `nfa_char' of the character itself.  */
+  ptrdiff_t p;
+};
+
+/* Decode the compiled pattern in BUFP into PROG, which must have room
+   for BUFP->used instructions.  AT must have room for BUFP->used ints,
+   and is used to map pattern offsets to instructions.  Return the
+   number of instructions, or -1 if the pattern needs re_match_2_internal.
+   Set *PRONE if the pattern has a loop that re_match_2_internal might
+   have to back up through.  */
+
+static ptrdiff_t
+nfa_compile (struct re_pattern_buffer *bufp, struct nfa_inst *prog, int *at,
+	     bool *prone)
+{
+  re_char *buffer = bufp->buffer;
+  re_char *pend = buffer + bufp->used;
+  re_char *p = buffer;
+  const boolean multibyte = RE_MULTIBYTE_P (bufp);
+  ptrdiff_t n = 0, i;
+  int mcnt;
+
+  *prone = false;
+  for (i = 0; i < bufp->used; i++)
+    at[i] = -1;
+
+  while (p < pend)
+    {
+      re_char *op = p;
+      re_char *dest;
+
+      at[op - buffer] = n;
+      prog[n].simple = false;
+      prog[n].x = 0;
+      prog[n].p = op - buffer;
+
+      switch (*p++)
+	{
+	case no_op:
+	  break;
+
+	case succeed:
+	  /* Only `posix_backtracking' patterns lack this at their end,
+	     and those want the longest match rather than the first.  */
+	  if (p != pend)
+	    return -1;
+	  prog[n++].op = nfa_succeed;
+	  break;
+
+	case exactn:
+	  mcnt = *p++;
+	  for (dest = p + mcnt; p < dest;
+	       p += multibyte ? BYTES_BY_CHAR_HEAD (*p) : 1)
+	    {
+	      prog[n].op = nfa_char;
+	      prog[n].simple = false;
+	      prog[n].x = 0;
+	      prog[n++].p = p - buffer;
+	    }
+	  if (p != dest)
+	    return -1;
+	  break;
+
+	case anychar:
+	  prog[n++].op = nfa_anychar;
+	  break;
+
+	case charset:
+	case charset_not:
+	  prog[n++].op = nfa_charset;
+	  p = skip_one_char (op);
+	  break;
+
+	case start_memory:
+	case stop_memory:
+	  prog[n].op = (*op == start_memory
+			? nfa_start_memory : nfa_stop_memory);
+	  prog[n++].x = *p++;
+	  break;
+
+	case begline:
+	  prog[n++].op = nfa_begline;
+	  break;
+
+	case endline:
+	  prog[n++].op = nfa_endline;
+	  break;
+
+	case begbuf:
+	  prog[n++].op = nfa_begbuf;
+	  break;
+
+	case endbuf:
+	  prog[n++].op = nfa_endbuf;
+	  break;
+
+	case jump:
+	case on_failure_jump:
+	case on_failure_jump_loop:
+	case on_failure_jump_nastyloop:
+	  EXTRACT_NUMBER_AND_INCR (mcnt, p);
+	  prog[n].op = (*op == jump ? nfa_jump
+			: *op == on_failure_jump_loop ? nfa_loop
+			: *op == on_failure_jump_nastyloop ? nfa_nastyloop
+			: nfa_split);
+	  prog[n++].x = p + mcnt - buffer;
+	  break;
+
+	case on_failure_jump_smart:
+	case on_failure_keep_string_jump:
+	  /* A loop around a single character, which the backtracking
+	     matcher may have rewritten into a loop around an
+	     `on_failure_keep_string_jump'; its closing jump then goes
+	     back to just after that.  */
+	  EXTRACT_NUMBER_AND_INCR (mcnt, p);
+	  dest = p + mcnt;
+	  if (skip_one_char (p) != dest - 3 || (re_opcode_t) dest[-3] != jump
+	      || dest + extract_number (dest - 2)
+		 != (*op == on_failure_jump_smart ? op : p))
+	    return -1;
+	  prog[n].op = nfa_split;
+	  prog[n].simple = (*op == on_failure_keep_string_jump
+			    || mutually_exclusive_p (bufp, p, dest));
+	  prog[n++].x = dest - buffer;
+	  break;
+
+	default:
+	  return -1;
+	}
+    }
+
+  if (n == 0 || prog[n - 1].op != nfa_succeed)
+    return -1;
+
+  /* Turn pattern offsets into instructions.  */
+  for (i = 0; i < n; i++)
+    {
+      struct nfa_inst *inst = &prog[i];
+      int to = inst->x;
+
+      if (inst->op != nfa_jump && inst->op != nfa_split
+	  && inst->op != nfa_loop && inst->op != nfa_nastyloop)
+	continue;
+
+      if (inst->op == nfa_jump && 3 <= to && 0 <= at[to - 3]
+	  && prog[at[to - 3]].p == to - 3
+	  && (re_opcode_t) buffer[to - 3] == on_failure_keep_string_jump)
+	to -= 3;
+      if (to < 0 || bufp->used <= to || at[to] < 0)
+	return -1;
+      inst->x = at[to];
+
+      if (inst->x <= i
+	  && ! (inst->op == nfa_jump && prog[inst->x].op == nfa_split
+		&& prog[inst->x].simple))
+	*prone = true;
+      else if (inst->op == nfa_loop || inst->op == nfa_nastyloop)
+	*prone = true;
+    }
+
+  return n;
+}
+
+/* What an entry on the stack of nfa_add_thread asks for.  */
+enum nfa_entry_kind
+{
+  nfa_visit = -1,		/* Visit instruction PC.  */
+  nfa_enter = -2,		/* Visit PC, the body of loop VAL.  */
+  nfa_leave = -3,		/* Take instruction PC off the path.  */
+  nfa_leave_body = -4		/* Leave the body of loop PC.  */
+  /* A nonnegative kind is a register slot to set back to VAL.  */
+};
+
+struct nfa_entry
+{
+  int pc;
+  int slot;
+  regoff_t val;
+};
+
+/* The threads at one position of the text, in order of priority.  */
+struct nfa_list
+{
+  ptrdiff_t n;
+  int *pc;
+  regoff_t *caps;
+};
+
+struct nfa
+{
+  struct re_pattern_buffer *bufp;
+  const struct nfa_inst *prog;
+
+  /* The text, arranged as in re_match_2_internal.  */
+  re_char *string1, *string2;
+  ssize_t size1, total;
+
+  /* The fastmap to check starting positions against, or NULL.  */
+  char *fastmap;
+
+  /* Register slots carried by each thread: the start and end of each
+     group, where group 0 only records where the thread started.  */
+  int ncaps;
+
+  /* MARK[PC] is GEN if instruction PC has been visited at the current
+     position.  ONPATH[PC] is nonzero while visiting what can be reached
+     from it, and for a loop INBODY[PC] while visiting its body.  */
+  ptrdiff_t *mark, gen;
+  int *onpath, *inbody;
+
+  /* The stack of nfa_add_thread, with room for NSTACK entries, and
+     whether it ever ran out of room.  */
+  struct nfa_entry *stack;
+  ptrdiff_t nstack;
+  bool overflow;
+
+  regoff_t *cur;
+};
+
+/* Return the address of the byte at POS in NFA's text.  */
+static re_char *
+nfa_addr (struct nfa *nfa, ssize_t pos)
+{
+  return (pos < nfa->size1
+	  ? nfa->string1 + pos
+	  : nfa->string2 + (pos - nfa->size1));
+}
+
+/* Add to LIST the threads that reach a character-matching instruction
+   or the end of the pattern from instruction PC at position POS,
+   starting with register slots CAPS, or with fresh ones if CAPS is
+   NULL.
+
+   This walks the alternatives depth first, in the order
+   re_match_2_internal would try them.  An instruction already visited
+   at POS is not visited again, since whatever it leads to has been
+   added already with a higher priority, except when coming back to it
+   from what it leads to, through a loop that matched the empty string.
+   re_match_2_internal carries on then until it notices the empty
+   iteration at the loop, and so must we, to end up with the same
+   registers.  */
+static void
+nfa_add_thread (struct nfa *nfa, struct nfa_list *list, int pc,
+		const regoff_t *caps, ssize_t pos)
+{
+  const struct nfa_inst *prog = nfa->prog;
+  struct re_pattern_buffer *bufp = nfa->bufp;
+  struct nfa_entry *stack = nfa->stack;
+  regoff_t *cur = nfa->cur;
+  int ncaps = nfa->ncaps;
+  ptrdiff_t sp = 0;
+  int i;
+
+  if (caps)
+    memcpy (cur, caps, ncaps * sizeof *cur);
+  else
+    {
+      for (i = 1; i < ncaps; i++)
+	cur[i] = -1;
+      cur[0] = pos;
+    }
+
+  stack[sp].pc = pc;
+  stack[sp++].slot = nfa_visit;
+
+  while (sp > 0)
+    {
+      struct nfa_entry *e = &stack[--sp];
+
+      switch (e->slot)
+	{
+	case nfa_leave:
+	  nfa->onpath[e->pc]--;
+	  continue;
+
+	case nfa_leave_body:
+	  nfa->inbody[e->pc]--;
+	  continue;
+
+	case nfa_enter:
+	  pc = e->pc;
+	  nfa->inbody[e->val]++;
+	  stack[sp].pc = e->val;
+	  stack[sp++].slot = nfa_leave_body;
+	  break;
+
+	case nfa_visit:
+	  pc = e->pc;
+	  break;
+
+	default:
+	  cur[e->slot] = e->val;
+	  continue;
+	}
+
+      for (;;)
+	{
+	  const struct nfa_inst *inst = &prog[pc];
+	  int slot;
+
+	  if (nfa->mark[pc] == nfa->gen)
+	    {
+	      /* An empty iteration of a loop: leave it.  */
+	      if (nfa->inbody[pc])
+		{
+		  pc = inst->op == nfa_loop ? inst->x : pc + 1;
+		  continue;
+		}
+	      if (!nfa->onpath[pc])
+		break;
+	    }
+	  nfa->mark[pc] = nfa->gen;
+
+	  if (inst->op <= nfa_charset || inst->op == nfa_succeed)
+	    {
+	      list->pc[list->n] = pc;
+	      memcpy (list->caps + list->n * ncaps, cur, ncaps * sizeof *cur);
+	      list->n++;
+	      break;
+	    }
+
+	  switch (inst->op)
+	    {
+	    case nfa_begline:
+	      if (pos == 0 ? bufp->not_bol : *nfa_addr (nfa, pos - 1) != '\n')
+		goto dead_end;
+	      break;
+
+	    case nfa_endline:
+	      if (pos == nfa->total
+		  ? bufp->not_eol : *nfa_addr (nfa, pos) != '\n')
+		goto dead_end;
+	      break;
+
+	    case nfa_begbuf:
+	      if (pos != 0)
+		goto dead_end;
+	      break;
+
+	    case nfa_endbuf:
+	      if (pos != nfa->total)
+		goto dead_end;
+	      break;
+
+	    default:
+	      break;
+	    }
+
+	  if (nfa->nstack - 4 < sp)
+	    {
+	      nfa->overflow = true;
+	      return;
+	    }
+
+	  nfa->onpath[pc]++;
+	  stack[sp].pc = pc;
+	  stack[sp++].slot = nfa_leave;
+
+	  switch (inst->op)
+	    {
+	    case nfa_jump:
+	      pc = inst->x;
+	      continue;
+
+	    case nfa_split:
+	      stack[sp].pc = inst->x;
+	      stack[sp++].slot = nfa_visit;
+	      break;
+
+	    case nfa_loop:
+	      stack[sp].pc = inst->x;
+	      stack[sp++].slot = nfa_visit;
+	      nfa->inbody[pc]++;
+	      stack[sp].pc = pc;
+	      stack[sp++].slot = nfa_leave_body;
+	      break;
+
+	    case nfa_nastyloop:
+	      /* The body of this loop comes second.  */
+	      stack[sp].pc = inst->x;
+	      stack[sp].slot = nfa_enter;
+	      stack[sp++].val = pc;
+	      break;
+
+	    case nfa_start_memory:
+	    case nfa_stop_memory:
+	      slot = 2 * inst->x;
+	      if (slot + 1 < ncaps)
+		{
+		  for (i = inst->op == nfa_start_memory ? slot : slot + 1;
+		       i <= slot + 1; i++)
+		    {
+		      stack[sp].slot = i;
+		      stack[sp++].val = cur[i];
+		    }
+		  if (inst->op == nfa_start_memory)
+		    {
+		      cur[slot] = pos;
+		      cur[slot + 1] = -1;
+		    }
+		  else
+		    cur[slot + 1] = pos;
+		}
+	      break;
+
+	    default:
+	      break;
+	    }
+	  pc++;
+	}
+    dead_end:;
+    }
+}
+
+/* Return true if the character at D, which is CORIG, satisfies the
+   character-matching instruction INST.  This must agree with the
+   corresponding cases of re_match_2_internal.  */
+static bool
+nfa_char_matches (struct nfa *nfa, const struct nfa_inst *inst,
+		  re_char *d, re_wchar_t corig)
+{
+  struct re_pattern_buffer *bufp = nfa->bufp;
+  RE_TRANSLATE_TYPE translate = bufp->translate;
+  const boolean multibyte = RE_MULTIBYTE_P (bufp);
+  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  re_char *p = bufp->buffer + inst->p;
+
+  switch (inst->op)
+    {
+    case nfa_char:
+      {
+#ifndef emacs
+	return (RE_TRANSLATE_P (translate)
+		? RE_TRANSLATE (translate, *d) : *d) == *p;
+#else
+	int pat_ch, buf_ch;
+
+	if (target_multibyte)
+	  {
+	    pat_ch = multibyte ? STRING_CHAR (p) : RE_CHAR_TO_MULTIBYTE (*p);
+	    return TRANSLATE (corig) == pat_ch;
+	  }
+
+	pat_ch = multibyte ? RE_CHAR_TO_UNIBYTE (STRING_CHAR (p)) : *p;
+	buf_ch = RE_CHAR_TO_MULTIBYTE (*d);
+	if (! CHAR_BYTE8_P (buf_ch))
+	  {
+	    buf_ch = TRANSLATE (buf_ch);
+	    buf_ch = RE_CHAR_TO_UNIBYTE (buf_ch);
+	    if (buf_ch < 0)
+	      buf_ch = *d;
+	  }
+	else
+	  buf_ch = *d;
+	return buf_ch == pat_ch;
+#endif
+      }
+
+    case nfa_anychar:
+      {
+	re_wchar_t buf_ch = TRANSLATE (corig);
+	reg_syntax_t syntax;
+
+#ifdef emacs
+	syntax = RE_SYNTAX_EMACS;
+#else
+	syntax = bufp->syntax;
+#endif
+	return ! ((!(syntax & RE_DOT_NEWLINE) && buf_ch == '\n')
+		  || ((syntax & RE_DOT_NOT_NULL) && buf_ch == '\000'));
+      }
+
+    case nfa_charset:
+      {
+	unsigned int c = corig;
+	boolean unibyte_char = false;
+
+	if (target_multibyte)
+	  {
+	    int c1;
+
+	    c = TRANSLATE (c);
+	    c1 = RE_CHAR_TO_UNIBYTE (c);
+	    if (c1 >= 0)
+	      {
+		unibyte_char = true;
+		c = c1;
+	      }
+	  }
+	else
+	  {
+	    int c1 = RE_CHAR_TO_MULTIBYTE (c);
+
+	    if (! CHAR_BYTE8_P (c1))
+	      {
+		c1 = TRANSLATE (c1);
+		c1 = RE_CHAR_TO_UNIBYTE (c1);
+		if (c1 >= 0)
+		  {
+		    unibyte_char = true;
+		    c = c1;
+		  }
+	      }
+	    else
+	      unibyte_char = true;
+	  }
+
+	return execute_charset (&p, c, corig, unibyte_char);
+      }
+
+    default:
+      return false;
+    }
+}
+
+/* Return true if a match might start at POS, according to NFA's
+   fastmap.  */
+static bool
+nfa_may_start (struct nfa *nfa, ssize_t pos)
+{
+  struct re_pattern_buffer *bufp = nfa->bufp;
+  RE_TRANSLATE_TYPE translate = bufp->translate;
+  char *fastmap = nfa->fastmap;
+  re_char *d;
+  re_wchar_t buf_ch;
+
+  if (!fastmap)
+    return true;
+  if (pos == nfa->total)
+    return false;
+
+  d = nfa_addr (nfa, pos);
+  if (RE_TARGET_MULTIBYTE_P (bufp))
+    {
+      buf_ch = STRING_CHAR (d);
+      buf_ch = TRANSLATE (buf_ch);
+      return fastmap[CHAR_LEADING_CODE (buf_ch)];
+    }
+  else
+    {
+      re_wchar_t ch, translated;
+
+      buf_ch = *d;
+      ch = RE_CHAR_TO_MULTIBYTE (buf_ch);
+      translated = TRANSLATE (ch);
+      if (translated != ch && (ch = RE_CHAR_TO_UNIBYTE (translated)) >= 0)
+	buf_ch = ch;
+      return fastmap[buf_ch];
+    }
+}
+
+/* Look for a match of NFA's program that starts between FIRST and
+   LAST inclusive, consuming no text at or after STOP.  Return where
+   the first such match starts, or -1.  On success, copy the registers
+   of the match to BEST and store its end in *END.  CLIST and NLIST
+   are scratch lists with room for every instruction.  */
+static ssize_t
+nfa_run (struct nfa *nfa, struct nfa_list *clist, struct nfa_list *nlist,
+	 ssize_t first, ssize_t last, ssize_t stop,
+	 regoff_t *best, ssize_t *end)
+{
+  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (nfa->bufp);
+  const struct nfa_inst *prog = nfa->prog;
+  int ncaps = nfa->ncaps;
+  ssize_t pos = first, matched = -1;
+
+  clist->n = 0;
+  nfa->gen++;
+  if (nfa_may_start (nfa, pos))
+    nfa_add_thread (nfa, clist, 0, NULL, pos);
+
+  for (;;)
+    {
+      struct nfa_list *tmp;
+      bool step = pos < stop;
+      re_char *d = NULL;
+      re_wchar_t c = 0;
+      int len = 0;
+      ptrdiff_t i;
+
+      if (pos < nfa->total)
+	{
+	  d = nfa_addr (nfa, pos);
+	  c = RE_STRING_CHAR_AND_LENGTH (d, len, target_multibyte);
+	}
+
+      nfa->gen++;
+      nlist->n = 0;
+      for (i = 0; i < clist->n; i++)
+	{
+	  int pc = clist->pc[i];
+	  regoff_t *caps = clist->caps + i * ncaps;
+
+	  if (prog[pc].op == nfa_succeed)
+	    {
+	      /* Threads after this one would only be tried once it
+		 had failed.  */
+	      matched = caps[0];
+	      memcpy (best, caps, ncaps * sizeof *caps);
+	      *end = pos;
+	      break;
+	    }
+	  if (step && nfa_char_matches (nfa, &prog[pc], d, c))
+	    nfa_add_thread (nfa, nlist, pc + 1, caps, pos + len);
+	}
+
+      if (nfa->overflow
+	  || !step || (nlist->n == 0 && (0 <= matched || last <= pos)))
+	break;
+
+      pos += len;
+      if (matched < 0 && pos <= last && nfa_may_start (nfa, pos))
+	nfa_add_thread (nfa, nlist, 0, NULL, pos);
+
+      tmp = clist, clist = nlist, nlist = tmp;
+      maybe_quit ();
+    }
+
+  return matched;
+}
+
+/* Store into REGS the registers of a match of BUFP, which has NUM_REGS
+   of them, given its register slots CAPS and its END.  Return false
+   if memory runs out.  This mirrors the end of re_match_2_internal.  */
+static bool
+nfa_store_registers (struct re_pattern_buffer *bufp,
+		     struct re_registers *regs, size_t num_regs,
+		     const regoff_t *caps, regoff_t end)
+{
+  size_t reg;
+
+  if (bufp->regs_allocated == REGS_UNALLOCATED)
+    {
+      regs->num_regs = max (RE_NREGS, num_regs + 1);
+      regs->start = TALLOC (regs->num_regs, regoff_t);
+      regs->end = TALLOC (regs->num_regs, regoff_t);
+      if (regs->start == NULL || regs->end == NULL)
+	return false;
+      bufp->regs_allocated = REGS_REALLOCATE;
+    }
+  else if (bufp->regs_allocated == REGS_REALLOCATE)
+    {
+      if (regs->num_regs < num_regs + 1)
+	{
+	  regs->num_regs = num_regs + 1;
+	  RETALLOC (regs->start, regs->num_regs, regoff_t);
+	  RETALLOC (regs->end, regs->num_regs, regoff_t);
+	  if (regs->start == NULL || regs->end == NULL)
+	    return false;
+	}
+    }
+  else
+    {
+      assert (bufp->regs_allocated == REGS_FIXED);
+    }
+
+  if (regs->num_regs > 0)
+    {
+      regs->start[0] = caps[0];
+      regs->end[0] = end;
+    }
+
+  for (reg = 1; reg < min (num_regs, regs->num_regs); reg++)
+    {
+      if (caps[2 * reg] < 0 || caps[2 * reg + 1] < 0)
+	regs->start[reg] = regs->end[reg] = -1;
+      else
+	{
+	  regs->start[reg] = caps[2 * reg];
+	  regs->end[reg] = caps[2 * reg + 1];
+	}
+    }
+
+  for (reg = num_regs; reg < regs->num_regs; reg++)
+    regs->start[reg] = regs->end[reg] = -1;
+
+  return true;
+}
+
+/* If the pattern in BUFP is prone to backtracking but can be matched
+   without it, do what re_search_2 would do with the same arguments if
+   SEARCH, or else what re_match_2 would do from position STARTPOS,
+   store the value it would return in *RESULT, and return true.
+   Otherwise return false, leaving the work to re_match_2_internal.  */
+static bool
+re_nfa_2 (struct re_pattern_buffer *bufp, re_char *string1, size_t size1,
+	  re_char *string2, size_t size2, ssize_t startpos, ssize_t range,
+	  struct re_registers *regs, ssize_t stop, bool search,
+	  regoff_t *result)
+{
+  size_t num_regs = bufp->re_nsub + 1;
+  const boolean target_multibyte = RE_TARGET_MULTIBYTE_P (bufp);
+  struct nfa_list lists[2];
+  struct nfa nfa;
+  regoff_t *best;
+  ptrdiff_t ninst, i;
+  ssize_t matched, end;
+
+  if ((bufp->nfa_checked && !bufp->nfa_usable) || bufp->used == 0)
+    return false;
+
+  /* Decode the pattern the first time, and keep the program in BUFP
+     until the pattern is compiled again.  */
+  if (!bufp->nfa_checked)
+    {
+      struct nfa_inst *prog = malloc (bufp->used * sizeof *prog);
+      int *at = malloc (bufp->used * sizeof *at);
+      bool prone;
+
+      if (!prog || !at)
+	{
+	  free (prog);
+	  free (at);
+	  return false;
+	}
+      ninst = nfa_compile (bufp, prog, at, &prone);
+      free (at);
+      bufp->nfa_checked = 1;
+      bufp->nfa_usable = 0 <= ninst && prone;
+      if (!bufp->nfa_usable)
+	{
+	  free (prog);
+	  return false;
+	}
+      bufp->nfa_prog = realloc (prog, ninst * sizeof *prog);
+      if (!bufp->nfa_prog)
+	bufp->nfa_prog = prog;
+      bufp->nfa_size = ninst;
+    }
+  ninst = bufp->nfa_size;
+
+  REGEX_USE_SAFE_ALLOCA;
+
+  if (size2 == 0 && string1 != NULL)
+    {
+      string2 = string1;
+      size2 = size1;
+      string1 = 0;
+      size1 = 0;
+    }
+
+  nfa.bufp = bufp;
+  nfa.prog = bufp->nfa_prog;
+  nfa.string1 = string1;
+  nfa.string2 = string2;
+  nfa.size1 = size1;
+  nfa.total = size1 + size2;
+  nfa.fastmap = search && !bufp->can_be_null ? bufp->fastmap : NULL;
+  nfa.ncaps = regs && !bufp->no_sub ? 2 * num_regs : 2;
+  nfa.mark = REGEX_TALLOC (ninst, ptrdiff_t);
+  nfa.gen = 0;
+  nfa.onpath = REGEX_TALLOC (ninst, int);
+  nfa.inbody = REGEX_TALLOC (ninst, int);
+  nfa.nstack = 8 * ninst + 8;
+  nfa.stack = REGEX_TALLOC (nfa.nstack, struct nfa_entry);
+  nfa.overflow = false;
+  nfa.cur = REGEX_TALLOC (nfa.ncaps, regoff_t);
+  best = REGEX_TALLOC (nfa.ncaps, regoff_t);
+  for (i = 0; i < 2; i++)
+    {
+      lists[i].pc = REGEX_TALLOC (ninst, int);
+      lists[i].caps = REGEX_TALLOC (ninst * nfa.ncaps, regoff_t);
+    }
+  for (i = 0; i < ninst; i++)
+    nfa.mark[i] = nfa.onpath[i] = nfa.inbody[i] = 0;
+
+  if (startpos < 0 || startpos > nfa.total)
+    matched = -1;
+  else if (0 <= range)
+    matched = nfa_run (&nfa, &lists[0], &lists[1], startpos,
+		       search ? startpos + range : startpos, stop,
+		       best, &end);
+  else
+    {
+      /* Searching backwards: try each starting position in turn.  */
+      ssize_t pos = startpos, lim = startpos + range;
+
+      for (;;)
+	{
+	  matched = (nfa_may_start (&nfa, pos)
+		     ? nfa_run (&nfa, &lists[0], &lists[1], pos, pos, stop,
+				best, &end)
+		     : -1);
+	  if (0 <= matched || pos <= lim || nfa.overflow)
+	    break;
+
+	  pos--;
+	  if (target_multibyte)
+	    {
+	      re_char *p = nfa_addr (&nfa, pos) + 1, *p0 = p;
+	      re_char *phead = pos < size1 ? string1 : string2;
+
+	      PREV_CHAR_BOUNDARY (p, phead);
+	      pos -= p0 - 1 - p;
+	      if (pos < lim)
+		break;
+	    }
+	}
+    }
+
+  /* Loops within loops that match the empty string can make the walk
+     through the alternatives too long; leave those to the backtracking
+     matcher.  */
+  if (nfa.overflow)
+    {
+      bufp->nfa_usable = 0;
+      REGEX_SAFE_FREE ();
+      return false;
+    }
+
+  if (0 <= matched && regs && !bufp->no_sub
+      && !nfa_store_registers (bufp, regs, num_regs, best, end))
+    *result = -2;
+  else if (matched < 0 || search)
+    *result = matched;
+  else
+    *result = end - matched;
+
+  REGEX_SAFE_FREE ();
+  return true;
+}
+
+
 /* Matching routines.  */
 
 #ifndef emacs	/* Emacs never uses this.  */
@@ -4915,6 +5876,10 @@ re_match_2 (struct re_pattern_buffer *bufp, const char *string1,
   SETUP_SYNTAX_TABLE_FOR_OBJECT (re_match_object, charpos, 1);
 #endif
 
+  if (re_nfa_2 (bufp, (re_char *) string1, size1, (re_char *) string2, size2,
+		pos, 0, regs, stop, false, &result))
+    return result;
+
   result = re_match_2_internal (bufp, (re_char *) string1, size1,
 				(re_char *) string2, size2,
 				pos, regs, stop);
@@ -6407,6 +7372,7 @@ regcomp (regex_t *_Restrict_ preg, const char *_Restrict_ pattern,
   preg->buffer = 0;
   preg->allocated = 0;
   preg->used = 0;
+  preg->nfa_prog = 0;
 
   /* Try to allocate space for the fastmap.  */
   preg->fastmap = malloc (1 << BYTEWIDTH);
@@ -6518,6 +7484,11 @@ regexec (const regex_t *_Restrict_ preg, const char *_Restrict_ string,
 		   /* start: */ 0, /* range: */ len,
 		   want_reg_info ? &regs : 0);
 
+  /* A program for matching without backtracking that was decoded for
+     the copy cannot be kept in PREG.  */
+  if (private_preg.nfa_prog != preg->nfa_prog)
+    free (private_preg.nfa_prog);
+
   /* Copy the register information to the POSIX structure.  */
   if (want_reg_info)
     {
@@ -6599,6 +7570,10 @@ regfree (regex_t *preg)
 
   free (preg->translate);
   preg->translate = NULL;
+
+  free (preg->nfa_prog);
+  preg->nfa_prog = NULL;
+  preg->nfa_checked = 0;
 }
 WEAK_ALIAS (__regfree, regfree)
 
@@ -353,6 +353,8 @@ typedef enum
 # define RE_TRANSLATE_TYPE char *
 #endif
 
+struct nfa_inst;
+
 struct re_pattern_buffer
 {
 /* [[[begin pattern_buffer]]] */
@@ -391,6 +393,12 @@ struct re_pattern_buffer
            this absolutely perfectly; see `re_compile_fastmap'.  */
   unsigned can_be_null : 1;
 
+        /* If nonzero, every match starts with the `prefix_size' bytes at
+           offset `prefix' in `buffer', which `re_search_2' can look for
+           with memchr.  Set by `re_compile_fastmap'.  */
+  size_t prefix;
+  unsigned char prefix_size;
+
         /* If REGS_UNALLOCATED, allocate space in the `regs' structure
              for `max (RE_NREGS, re_nsub + 1)' groups.
            If REGS_REALLOCATE, reallocate space if necessary.
@@ -419,6 +427,17 @@ struct re_pattern_buffer
      so the compiled pattern is only valid for the current syntax table.  */
   unsigned used_syntax : 1;
 
+  /* Set by `re_search_2' and `re_match_2' once they know whether the
+     pattern is better matched without backtracking, and if so by
+     `nfa_usable'.  */
+  unsigned nfa_checked : 1;
+  unsigned nfa_usable : 1;
+
+  /* The program for matching without backtracking, of `nfa_size'
+     instructions, while `nfa_usable'.  */
+  struct nfa_inst *nfa_prog;
+  ptrdiff_t nfa_size;
+
 #ifdef emacs
   /* If true, multi-byte form in the regexp pattern should be
      recognized as a multibyte character.  */
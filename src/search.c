@@ -32,13 +32,17 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 
 #include "regex.h"
 
-#define REGEXP_CACHE_SIZE 20
-
 /* If the regexp is non-nil, then the buffer contains the compiled form
    of that regexp, suitable for searching.  */
 struct regexp_cache
 {
-  struct regexp_cache *next;
+  /* Neighbors in the list of entries in use, most recently used first,
+     or the next free entry.  */
+  struct regexp_cache *next, *prev;
+  /* The next entry in the same bucket of the hash table.  */
+  struct regexp_cache *chain;
+  /* What regexp_cache_hash returned for this entry.  */
+  EMACS_UINT hash;
   Lisp_Object regexp, f_whitespace_regexp;
   /* Syntax table for which the regexp applies.  We need this because
      of character classes.  If this is t, then the compiled pattern is valid
@@ -50,11 +54,17 @@ struct regexp_cache
   bool posix;
 };
 
-/* The instances of that struct.  */
-static struct regexp_cache searchbufs[REGEXP_CACHE_SIZE];
+/* The head and tail of the list of entries in use; the head is the most
+   recently used one.  There are searchbuf_count of them.  */
+static struct regexp_cache *searchbuf_head, *searchbuf_tail;
+static EMACS_INT searchbuf_count;
+
+/* Entries that were taken out of use, whose buffers can be reused.  */
+static struct regexp_cache *searchbuf_free;
 
-/* The head of the linked list; points to the most recently used buffer.  */
-static struct regexp_cache *searchbuf_head;
+/* The hash table of the entries in use.  Its size is a power of 2.  */
+static struct regexp_cache **searchbuf_table;
+static ptrdiff_t searchbuf_table_size;
 
 
 /* Every call to re_match, etc., must pass &search_regs as the regs
@@ -183,6 +193,52 @@ shrink_regexp_cache (void)
     }
 }
 
+/* Mark the Lisp objects referred to by the regexp cache.
+   This is called from garbage collection.  */
+
+void
+mark_regexp_cache (void)
+{
+  struct regexp_cache *cp;
+
+  for (cp = searchbuf_head; cp != 0; cp = cp->next)
+    {
+      mark_object (cp->regexp);
+      mark_object (cp->f_whitespace_regexp);
+      mark_object (cp->syntax_table);
+      mark_object (cp->buf.translate);
+    }
+}
+
+/* Take CP, which is in use, out of the cache and put it on the free
+   list.  */
+
+static void
+free_regexp_cache_entry (struct regexp_cache *cp)
+{
+  struct regexp_cache **cpp;
+
+  for (cpp = &searchbuf_table[cp->hash & (searchbuf_table_size - 1)];
+       *cpp != cp; cpp = &(*cpp)->chain)
+    continue;
+  *cpp = cp->chain;
+
+  if (cp->prev)
+    cp->prev->next = cp->next;
+  else
+    searchbuf_head = cp->next;
+  if (cp->next)
+    cp->next->prev = cp->prev;
+  else
+    searchbuf_tail = cp->prev;
+  searchbuf_count--;
+
+  cp->regexp = cp->f_whitespace_regexp = cp->syntax_table = Qnil;
+  cp->buf.translate = make_number (0);
+  cp->next = searchbuf_free;
+  searchbuf_free = cp;
+}
+
 /* Clear the regexp cache w.r.t. a particular syntax table,
    because it was changed.
    There is no danger of memory leak here because re_compile_pattern
@@ -191,14 +247,80 @@ shrink_regexp_cache (void)
 void
 clear_regexp_cache (void)
 {
-  int i;
-
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    /* It's tempting to compare with the syntax-table we've actually changed,
-       but it's not sufficient because char-table inheritance means that
-       modifying one syntax-table can change others at the same time.  */
-    if (!EQ (searchbufs[i].syntax_table, Qt))
-      searchbufs[i].regexp = Qnil;
+  struct regexp_cache *cp, *next;
+
+  for (cp = searchbuf_head; cp != 0; cp = next)
+    {
+      next = cp->next;
+      /* It's tempting to compare with the syntax-table we've actually
+	 changed, but it's not sufficient because char-table inheritance
+	 means that modifying one syntax-table can change others at the
+	 same time.  */
+      if (!EQ (cp->syntax_table, Qt))
+	free_regexp_cache_entry (cp);
+    }
+}
+
+/* Return the hash code under which PATTERN, compiled with TRANSLATE
+   and POSIX, goes in the regexp cache.  The syntax table and
+   search-spaces-regexp are left out; they are compared afterwards.  */
+
+static EMACS_UINT
+regexp_cache_hash (Lisp_Object pattern, Lisp_Object translate, bool posix)
+{
+  EMACS_UINT hash = hash_string (SSDATA (pattern), SBYTES (pattern));
+  hash = sxhash_combine (hash, XHASH (translate));
+  return sxhash_combine (hash, STRING_MULTIBYTE (pattern) * 2 + posix);
+}
+
+/* Return an entry for a pattern with hash code HASH, the least recently
+   used one if the cache is full.  The entry is on neither list.  */
+
+static struct regexp_cache *
+get_regexp_cache_entry (EMACS_UINT hash)
+{
+  struct regexp_cache *cp;
+  EMACS_INT size = max (1, regexp_cache_size);
+
+  while (searchbuf_count >= size)
+    free_regexp_cache_entry (searchbuf_tail);
+
+  /* Keep the hash table no more than full.  */
+  if (searchbuf_table_size <= searchbuf_count)
+    {
+      ptrdiff_t i, n = max (16, searchbuf_table_size);
+      struct regexp_cache **table;
+
+      while (n <= searchbuf_count)
+	n *= 2;
+      table = xzalloc (n * sizeof *table);
+      for (cp = searchbuf_head; cp != 0; cp = cp->next)
+	{
+	  i = cp->hash & (n - 1);
+	  cp->chain = table[i];
+	  table[i] = cp;
+	}
+      xfree (searchbuf_table);
+      searchbuf_table = table;
+      searchbuf_table_size = n;
+    }
+
+  if (searchbuf_free)
+    {
+      cp = searchbuf_free;
+      searchbuf_free = cp->next;
+    }
+  else
+    {
+      cp = xzalloc (sizeof *cp);
+      cp->buf.allocated = 100;
+      cp->buf.buffer = xmalloc (100);
+      cp->buf.fastmap = cp->fastmap;
+      cp->regexp = cp->f_whitespace_regexp = cp->syntax_table = Qnil;
+      cp->buf.translate = make_number (0);
+    }
+  cp->hash = hash;
+  return cp;
 }
 
 /* Compile a regexp if necessary, but first check to see if there's one in
@@ -216,46 +338,72 @@ struct re_pattern_buffer *
 compile_pattern (Lisp_Object pattern, struct re_registers *regp,
 		 Lisp_Object translate, bool posix, bool multibyte)
 {
-  struct regexp_cache *cp, **cpp;
-
-  for (cpp = &searchbuf_head; ; cpp = &cp->next)
+  struct regexp_cache *cp;
+  EMACS_UINT hash;
+
+  if (NILP (translate))
+    translate = make_number (0);
+  hash = regexp_cache_hash (pattern, translate, posix);
+
+  for (cp = (searchbuf_table_size
+	     ? searchbuf_table[hash & (searchbuf_table_size - 1)] : 0);
+       cp != 0; cp = cp->chain)
+    if (cp->hash == hash
+	&& SBYTES (cp->regexp) == SBYTES (pattern)
+	&& STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
+	&& memcmp (SDATA (cp->regexp), SDATA (pattern), SBYTES (pattern)) == 0
+	&& EQ (cp->buf.translate, translate)
+	&& cp->posix == posix
+	&& (EQ (cp->syntax_table, Qt)
+	    || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
+	&& !NILP (Fequal (cp->f_whitespace_regexp, Vsearch_spaces_regexp))
+	&& cp->buf.charset_unibyte == charset_unibyte)
+      break;
+
+  if (cp)
     {
-      cp = *cpp;
-      /* Entries are initialized to nil, and may be set to nil by
-	 compile_pattern_1 if the pattern isn't valid.  Don't apply
-	 string accessors in those cases.  However, compile_pattern_1
-	 is only applied to the cache entry we pick here to reuse.  So
-	 nil should never appear before a non-nil entry.  */
-      if (NILP (cp->regexp))
-	goto compile_it;
-      if (SCHARS (cp->regexp) == SCHARS (pattern)
-	  && STRING_MULTIBYTE (cp->regexp) == STRING_MULTIBYTE (pattern)
-	  && !NILP (Fstring_equal (cp->regexp, pattern))
-	  && EQ (cp->buf.translate, (! NILP (translate) ? translate : make_number (0)))
-	  && cp->posix == posix
-	  && (EQ (cp->syntax_table, Qt)
-	      || EQ (cp->syntax_table, BVAR (current_buffer, syntax_table)))
-	  && !NILP (Fequal (cp->f_whitespace_regexp, Vsearch_spaces_regexp))
-	  && cp->buf.charset_unibyte == charset_unibyte)
-	break;
+      regexp_cache_hits++;
 
-      /* If we're at the end of the cache, compile into the nil cell
-	 we found, or the last (least recently used) cell with a
-	 string value.  */
-      if (cp->next == 0)
+      /* Move it to the front of the list to mark it as most recently
+	 used.  */
+      if (cp->prev)
 	{
-	compile_it:
-	  compile_pattern_1 (cp, pattern, translate, posix);
-	  break;
+	  cp->prev->next = cp->next;
+	  if (cp->next)
+	    cp->next->prev = cp->prev;
+	  else
+	    searchbuf_tail = cp->prev;
+	  cp->prev = 0;
+	  cp->next = searchbuf_head;
+	  searchbuf_head->prev = cp;
+	  searchbuf_head = cp;
 	}
     }
-
-  /* When we get here, cp (aka *cpp) contains the compiled pattern,
-     either because we found it in the cache or because we just compiled it.
-     Move it to the front of the queue to mark it as most recently used.  */
-  *cpp = cp->next;
-  cp->next = searchbuf_head;
-  searchbuf_head = cp;
+  else
+    {
+      ptrdiff_t i;
+
+      regexp_cache_misses++;
+      cp = get_regexp_cache_entry (hash);
+
+      /* If compiling signals an error, leave the entry free.  */
+      cp->next = searchbuf_free;
+      searchbuf_free = cp;
+      compile_pattern_1 (cp, pattern, translate, posix);
+      searchbuf_free = cp->next;
+
+      i = hash & (searchbuf_table_size - 1);
+      cp->chain = searchbuf_table[i];
+      searchbuf_table[i] = cp;
+      cp->prev = 0;
+      cp->next = searchbuf_head;
+      if (searchbuf_head)
+	searchbuf_head->prev = cp;
+      else
+	searchbuf_tail = cp;
+      searchbuf_head = cp;
+      searchbuf_count++;
+    }
 
   /* Advise the searching functions about the space we have allocated
      for register data.  */
@@ -577,6 +725,10 @@ newline_cache_on_off (struct buffer *buf)
 }
 
 
+/* Moves across at least this many newlines use the line index.  */
+
+enum { LINE_INDEX_MIN_COUNT = 1000 };
+
 /* Search for COUNT newlines between START/START_BYTE and END/END_BYTE.
 
    If COUNT is positive, search forwards; END must be >= START.
@@ -633,6 +785,39 @@ find_newline (ptrdiff_t start, ptrdiff_t start_byte, ptrdiff_t end,
   if (shortage != 0)
     *shortage = 0;
 
+  /* Long moves are answered by the buffer's line index.  */
+  if (LINE_INDEX_MIN_COUNT <= eabs (count))
+    {
+      if (start_byte == -1)
+	start_byte = CHAR_TO_BYTE (start);
+
+      ptrdiff_t before = buf_count_newlines (current_buffer, BEG_BYTE,
+					     start_byte);
+      ptrdiff_t target = before + count + (count < 0);
+      ptrdiff_t found = (0 < target
+			 ? buf_newline_position (current_buffer, target)
+			 : 0);
+
+      /* Going backwards, FOUND is after the newline we want, which
+	 must itself be at or after END.  */
+      if (found && (count > 0 ? found <= end_byte : end_byte < found))
+	{
+	  if (bytepos)
+	    *bytepos = found;
+	  return BYTE_TO_CHAR (found);
+	}
+
+      if (shortage)
+	*shortage = (eabs (count)
+		     - (count > 0
+			? buf_count_newlines (current_buffer, start_byte, end_byte)
+			: buf_count_newlines (current_buffer, end_byte,
+					      start_byte)));
+      if (bytepos)
+	*bytepos = end_byte;
+      return end;
+    }
+
   if (count > 0)
     while (start != end)
       {
@@ -1460,6 +1645,166 @@ search_buffer (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
     }
 }
 
+/* Return the list of (START . END) pairs of the matches of BUFP in the
+   text made of P1/S1 and P2/S2, at most LIMIT of them if LIMIT is
+   nonnegative.  OBJECT is the string the text belongs to, or nil for
+   the accessible portion of the current buffer; the positions are
+   character positions in OBJECT.  Use search_regs_1, leaving the match
+   data alone.  */
+
+static Lisp_Object
+re_search_all (struct re_pattern_buffer *bufp, Lisp_Object object,
+	       unsigned char *p1, ptrdiff_t s1,
+	       unsigned char *p2, ptrdiff_t s2, EMACS_INT limit)
+{
+  Lisp_Object matches = Qnil;
+  ptrdiff_t pos = 0, size = s1 + s2;
+  ptrdiff_t offset = STRINGP (object) ? 0 : BEGV_BYTE;
+
+  re_match_object = object;
+  while (limit != 0)
+    {
+      ptrdiff_t val, start, end;
+
+      val = re_search_2 (bufp, (char *) p1, s1, (char *) p2, s2,
+			 pos, size - pos, &search_regs_1, size);
+      if (val == -2)
+	matcher_overflow ();
+      if (val < 0)
+	break;
+
+      start = search_regs_1.start[0];
+      end = search_regs_1.end[0];
+      matches = Fcons ((STRINGP (object)
+			? Fcons (make_number (string_byte_to_char (object,
+								   start)),
+				 make_number (string_byte_to_char (object,
+								   end)))
+			: Fcons (make_number (BYTE_TO_CHAR (start + offset)),
+				 make_number (BYTE_TO_CHAR (end + offset)))),
+		       matches);
+      limit--;
+
+      /* After an empty match, look for the next one a character
+	 further on.  */
+      pos = end;
+      if (start == end)
+	{
+	  if (pos == size)
+	    break;
+	  pos += (bufp->target_multibyte
+		  ? BYTES_BY_CHAR_HEAD (pos < s1 ? p1[pos] : p2[pos - s1])
+		  : 1);
+	}
+      maybe_quit ();
+    }
+
+  return Fnreverse (matches);
+}
+
+DEFUN ("re-search-buffers", Fre_search_buffers, Sre_search_buffers, 2, 3, 0,
+       doc: /* Return where REGEXP matches in each of BUFFERS.
+BUFFERS is a list of buffers and strings.  The value is a list with an
+element for each element of BUFFERS: the list of (START . END) pairs of
+the matches of REGEXP in the accessible portion of that buffer, or in
+that string, in order.  A killed buffer gives nil.
+
+The matches are those that successive calls to `re-search-forward' from
+the beginning would find, except that after an empty match the search
+goes on from the next character.  Each buffer is searched with its own
+value of `case-fold-search'; strings with that of the current buffer.
+If LIMIT is non-nil, it is the most matches to return for each buffer.
+
+This compiles REGEXP once for all the buffers that can share the
+compiled form, and does not change the match data.  */)
+  (Lisp_Object regexp, Lisp_Object buffers, Lisp_Object limit)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct buffer *old = current_buffer;
+  Lisp_Object tail, result = Qnil;
+  EMACS_INT lim = -1;
+
+  CHECK_STRING (regexp);
+  CHECK_LIST (buffers);
+  if (!NILP (limit))
+    {
+      CHECK_NATNUM (limit);
+      lim = XFASTINT (limit);
+    }
+
+  record_unwind_current_buffer ();
+
+  for (tail = buffers; CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object object = XCAR (tail), matches = Qnil;
+      struct re_pattern_buffer *bufp;
+
+      if (STRINGP (object))
+	{
+	  set_buffer_internal (old);
+	  set_char_table_extras (BVAR (current_buffer, case_canon_table), 2,
+				 BVAR (current_buffer, case_eqv_table));
+	  bufp = compile_pattern (regexp, &search_regs_1,
+				  (!NILP (BVAR (current_buffer,
+						case_fold_search))
+				   ? BVAR (current_buffer, case_canon_table)
+				   : Qnil),
+				  false, STRING_MULTIBYTE (object));
+	  matches = re_search_all (bufp, object, NULL, 0,
+				   SDATA (object), SBYTES (object), lim);
+	}
+      else
+	{
+	  unsigned char *p1, *p2;
+	  ptrdiff_t s1, s2;
+
+	  CHECK_BUFFER (object);
+	  if (BUFFER_LIVE_P (XBUFFER (object)))
+	    {
+	      set_buffer_internal (XBUFFER (object));
+	      set_char_table_extras (BVAR (current_buffer, case_canon_table),
+				     2, BVAR (current_buffer, case_eqv_table));
+	      bufp = compile_pattern (regexp, &search_regs_1,
+				      (!NILP (BVAR (current_buffer,
+						    case_fold_search))
+				       ? BVAR (current_buffer,
+					       case_canon_table)
+				       : Qnil),
+				      false,
+				      !NILP (BVAR (current_buffer,
+						   enable_multibyte_characters)));
+	      maybe_quit ();
+
+	      /* Get pointers and sizes of the two strings
+		 that make up the visible portion of the buffer.  */
+	      p1 = BEGV_ADDR;
+	      s1 = GPT_BYTE - BEGV_BYTE;
+	      p2 = GAP_END_ADDR;
+	      s2 = ZV_BYTE - GPT_BYTE;
+	      if (s1 < 0)
+		{
+		  p2 = p1;
+		  s2 = ZV_BYTE - BEGV_BYTE;
+		  s1 = 0;
+		}
+	      if (s2 < 0)
+		{
+		  s1 = ZV_BYTE - BEGV_BYTE;
+		  s2 = 0;
+		}
+
+	      freeze_buffer_relocation ();
+	      matches = re_search_all (bufp, Qnil, p1, s1, p2, s2, lim);
+	      thaw_buffer_relocation ();
+	    }
+	}
+      result = Fcons (matches, result);
+    }
+  CHECK_LIST_END (tail, buffers);
+
+  return unbind_to (count, Fnreverse (result));
+}
+
 /* Do a simple string search N times for the string PAT,
    whose length is LEN/LEN_BYTE,
    from buffer position POS/POS_BYTE until LIM/LIM_BYTE.
@@ -1667,6 +2012,24 @@ simple_search (EMACS_INT n, unsigned char *pat,
     return n;
 }
 
+/* The tables boyer_moore made for the last string it searched for, so
+   that searching for it again, as isearch does, need not make them
+   again.  PAT is a copy of the string, of LEN_BYTE bytes out of SIZE
+   allocated, and the other fields up to STRIDE_FOR_TEASES are the
+   other arguments the tables depend on.  */
+static struct
+{
+  unsigned char *pat;
+  ptrdiff_t len_byte, size;
+  Lisp_Object trt, inverse_trt;
+  int direction, char_base;
+  bool multibyte;
+  int stride_for_teases;
+  int translate_prev_byte1, translate_prev_byte2, translate_prev_byte3;
+  int BM_tab[0400];
+  unsigned char simple_translate[0400];
+} bm_cache;
+
 /* Do Boyer-Moore search N times for the string BASE_PAT,
    whose length is LEN_BYTE,
    from buffer position POS_BYTE until LIM_BYTE.
@@ -1693,14 +2056,14 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
   register ptrdiff_t dirlen;
   ptrdiff_t limit;
   int stride_for_teases = 0;
-  int BM_tab[0400];
+  int *BM_tab = bm_cache.BM_tab;
   register unsigned char *cursor, *p_limit;
   register ptrdiff_t i;
   register int j;
   unsigned char *pat, *pat_end;
   bool multibyte = ! NILP (BVAR (current_buffer, enable_multibyte_characters));
 
-  unsigned char simple_translate[0400];
+  unsigned char *simple_translate = bm_cache.simple_translate;
   /* These are set to the preceding bytes of a byte to be translated
      if char_base is nonzero.  As the maximum byte length of a
      multibyte character is 5, we have to check at most four previous
@@ -1709,6 +2072,12 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
   int translate_prev_byte2 = 0;
   int translate_prev_byte3 = 0;
 
+  /* In a forward search without translation, whether to look for the
+     last byte of the pattern with memchr rather than striding, and how
+     well that has worked so far.  */
+  bool use_memchr = direction > 0 && NILP (trt);
+  EMACS_INT memchr_hits = 0, memchr_skipped = 0;
+
   /* The general approach is that we are going to maintain that we know
      the first (closest to the present position, in whatever direction
      we're searching) character that could possibly be the last
@@ -1740,6 +2109,26 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
   if (direction < 0)
     base_pat = pat_end - 1;
 
+  if (bm_cache.pat
+      && bm_cache.len_byte == len_byte
+      && !memcmp (bm_cache.pat, pat_end - len_byte, len_byte)
+      && EQ (bm_cache.trt, trt)
+      && EQ (bm_cache.inverse_trt, inverse_trt)
+      && bm_cache.direction == direction
+      && bm_cache.char_base == char_base
+      && bm_cache.multibyte == multibyte)
+    {
+      stride_for_teases = bm_cache.stride_for_teases;
+      translate_prev_byte1 = bm_cache.translate_prev_byte1;
+      translate_prev_byte2 = bm_cache.translate_prev_byte2;
+      translate_prev_byte3 = bm_cache.translate_prev_byte3;
+      goto search;
+    }
+
+  /* Forget the cached string until its new tables are complete, in
+     case making them fails.  */
+  bm_cache.len_byte = -1;
+
   /* A character that does not appear in the pattern induces a
      stride equal to the pattern length.  */
   for (i = 0; i < 0400; i++)
@@ -1843,6 +2232,25 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
 	 for that character if the last character had been
 	 different.  */
     }
+
+  if (bm_cache.size < len_byte)
+    {
+      bm_cache.pat = xrealloc (bm_cache.pat, len_byte);
+      bm_cache.size = len_byte;
+    }
+  memcpy (bm_cache.pat, pat_end - len_byte, len_byte);
+  bm_cache.len_byte = len_byte;
+  bm_cache.trt = trt;
+  bm_cache.inverse_trt = inverse_trt;
+  bm_cache.direction = direction;
+  bm_cache.char_base = char_base;
+  bm_cache.multibyte = multibyte;
+  bm_cache.stride_for_teases = stride_for_teases;
+  bm_cache.translate_prev_byte1 = translate_prev_byte1;
+  bm_cache.translate_prev_byte2 = translate_prev_byte2;
+  bm_cache.translate_prev_byte3 = translate_prev_byte3;
+
+ search:
   pos_byte += dirlen - ((direction > 0) ? direction : 0);
   /* loop invariant - POS_BYTE points at where last char (first
      char if reverse) of pattern would align in a possible match.  */
@@ -1889,7 +2297,28 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
 	  /* In this loop, pos + cursor - p2 is the surrogate for pos.  */
 	  while (1)		/* use one cursor setting as long as i can */
 	    {
-	      if (direction > 0) /* worth duplicating */
+	      if (use_memchr)
+		{
+		  /* memchr is much faster than striding, unless the
+		     byte it looks for is so common that striding skips
+		     more.  */
+		  unsigned char *found = NULL;
+
+		  if (cursor <= p_limit)
+		    found = memchr (cursor, pat_end[-1], p_limit - cursor + 1);
+		  if (found)
+		    {
+		      memchr_skipped += found - cursor;
+		      memchr_hits++;
+		      if (memchr_hits >= 16
+			  && memchr_skipped < memchr_hits * len_byte)
+			use_memchr = false;
+		      cursor = found;
+		      goto hit;
+		    }
+		  cursor = max (cursor, p_limit + 1);
+		}
+	      else if (direction > 0) /* worth duplicating */
 		{
 		  while (cursor <= p_limit)
 		    {
@@ -3133,23 +3562,6 @@ the buffer.  If the buffer doesn't have a cache, the value is nil.  */)
 void
 syms_of_search (void)
 {
-  register int i;
-
-  for (i = 0; i < REGEXP_CACHE_SIZE; ++i)
-    {
-      searchbufs[i].buf.allocated = 100;
-      searchbufs[i].buf.buffer = xmalloc (100);
-      searchbufs[i].buf.fastmap = searchbufs[i].fastmap;
-      searchbufs[i].regexp = Qnil;
-      searchbufs[i].f_whitespace_regexp = Qnil;
-      searchbufs[i].syntax_table = Qnil;
-      staticpro (&searchbufs[i].regexp);
-      staticpro (&searchbufs[i].f_whitespace_regexp);
-      staticpro (&searchbufs[i].syntax_table);
-      searchbufs[i].next = (i == REGEXP_CACHE_SIZE-1 ? 0 : &searchbufs[i+1]);
-    }
-  searchbuf_head = &searchbufs[0];
-
   /* Error condition used for failing searches.  */
   DEFSYM (Qsearch_failed, "search-failed");
 
@@ -3179,6 +3591,10 @@ syms_of_search (void)
   last_thing_searched = Qnil;
   staticpro (&last_thing_searched);
 
+  bm_cache.trt = bm_cache.inverse_trt = Qnil;
+  staticpro (&bm_cache.trt);
+  staticpro (&bm_cache.inverse_trt);
+
   saved_last_thing_searched = Qnil;
   staticpro (&saved_last_thing_searched);
 
@@ -3199,9 +3615,27 @@ do not set the match data.  The proper way to use this variable
 is to bind it with `let' around a small expression.  */);
   Vinhibit_changing_match_data = Qnil;
 
+  DEFVAR_INT ("regexp-cache-size", regexp_cache_size,
+	      doc: /* Maximum number of compiled regexps to keep.
+The searching and matching functions keep the regexps they compile,
+so that they need not compile them again the next time.  When the
+cache is full, the least recently used regexp is dropped.  */);
+  regexp_cache_size = 256;
+
+  DEFVAR_INT ("regexp-cache-hits", regexp_cache_hits,
+	      doc: /* Number of times a regexp was found in the regexp cache.
+See `regexp-cache-size'.  */);
+  regexp_cache_hits = 0;
+
+  DEFVAR_INT ("regexp-cache-misses", regexp_cache_misses,
+	      doc: /* Number of times a regexp had to be compiled.
+See `regexp-cache-size'.  */);
+  regexp_cache_misses = 0;
+
   defsubr (&Sreplace_match);
   defsubr (&Smatch_data);
   defsubr (&Sset_match_data);
   defsubr (&Sregexp_quote);
+  defsubr (&Sre_search_buffers);
   defsubr (&Snewline_cache_check);
 }
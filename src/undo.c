@@ -160,6 +160,54 @@ record_marker_adjustments (ptrdiff_t from, ptrdiff_t to)
     }
 }
 
+/* A deletion that continues the one recorded just before it, as when
+   deleting characters one at a time, is merged into that record while
+   the combined text is at most this long.  */
+enum { UNDO_DELETE_MERGE_MAX = 256 };
+
+/* If the head of the undo list records a deletion that the deletion of
+   STRING at BEG extends, with point on the same side, merge the two
+   and return true.  SBEG is the position as record_delete records it.
+   A record followed by marker adjustments is left alone, since
+   primitive-undo checks those against the position of its text.  */
+
+static bool
+merge_undo_delete (ptrdiff_t beg, Lisp_Object string, Lisp_Object sbeg)
+{
+  Lisp_Object list = BVAR (current_buffer, undo_list);
+
+  if (!CONSP (list) || !CONSP (XCAR (list)))
+    return false;
+
+  Lisp_Object elt = XCAR (list);
+  Lisp_Object old = XCAR (elt);
+
+  if (!STRINGP (old) || !INTEGERP (XCDR (elt))
+      || UNDO_DELETE_MERGE_MAX < SCHARS (old) + SCHARS (string)
+      || (CONSP (XCDR (list)) && CONSP (XCAR (XCDR (list)))
+	  && MARKERP (XCAR (XCAR (XCDR (list))))))
+    return false;
+
+  EMACS_INT pos = XINT (XCDR (elt));
+
+  /* Deleting backwards, with point at the end of the text.  */
+  if (pos < 0 && XINT (sbeg) < 0 && -pos == beg + SCHARS (string))
+    {
+      XSETCAR (elt, concat2 (string, old));
+      XSETCDR (elt, sbeg);
+      return true;
+    }
+
+  /* Deleting forwards, with point at the start.  */
+  if (0 < pos && 0 < XINT (sbeg) && pos == beg)
+    {
+      XSETCAR (elt, concat2 (old, string));
+      return true;
+    }
+
+  return false;
+}
+
 /* Record that a deletion is about to take place, of the characters in
    STRING, at location BEG.  Optionally record adjustments for markers
    in the region STRING occupies in the current buffer.  */
@@ -190,6 +238,9 @@ record_delete (ptrdiff_t beg, Lisp_Object string, bool record_markers)
   if (record_markers)
     record_marker_adjustments (beg, beg + SCHARS (string));
 
+  if (merge_undo_delete (beg, string, sbeg))
+    return;
+
   bset_undo_list
     (current_buffer,
      Fcons (Fcons (string, sbeg), BVAR (current_buffer, undo_list)));
@@ -24754,6 +24754,21 @@ display_count_lines (ptrdiff_t start_byte,
     = (!NILP (BVAR (current_buffer, selective_display))
        && !INTEGERP (BVAR (current_buffer, selective_display)));
 
+  /* If there are fewer than COUNT newlines before LIMIT_BYTE, all we
+     need is their number, which the line index knows.  Short spans
+     are not worth it, since counting them scans them anyway.  */
+  if (count > 0 && !selective_display
+      && LINE_INDEX_MIN_SPAN <= limit_byte - start_byte)
+    {
+      ptrdiff_t nlines
+	= buf_count_newlines (current_buffer, start_byte, limit_byte);
+      if (nlines < count)
+	{
+	  *byte_pos_ptr = limit_byte;
+	  return nlines;
+	}
+    }
+
   if (count > 0)
     {
       while (start_byte < limit_byte)
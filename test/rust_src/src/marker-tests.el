@@ -57,4 +57,19 @@
     (set-marker marker-2 marker-1)
     (should (goto-char marker-2))))
 
+(ert-deftest marker-position-bytes-with-many-markers ()
+  "Char/byte conversion stays exact with many markers in a multibyte buffer."
+  (with-temp-buffer
+    (dotimes (i 2000)
+      (insert (if (zerop (% i 3)) "\u00e9\u4e2d" "ab")))
+    (let ((pos (point-min)))
+      (while (< pos (point-max))
+        (copy-marker pos)
+        (setq pos (+ pos 7))))
+    (dolist (pos (list 1 2 3 500 1501 3000 4200 (point-max)))
+      (let ((byte (position-bytes pos)))
+        (should (= byte (1+ (string-bytes
+                              (buffer-substring-no-properties 1 pos)))))
+        (should (= (byte-to-position byte) pos))))))
+
 ;;; marker-tests.el ends here.
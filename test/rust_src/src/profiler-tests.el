@@ -18,5 +18,23 @@
   (should (not (profiler-memory-running-p)))
   (should (profiler-memory-log)))
 
+(ert-deftest test-profiler-memory-type-log ()
+  ;; Discard logs left over from earlier tests.
+  (profiler-memory-type-log)
+  (let ((profiler-alloc-sampling-interval 1))
+    (should (profiler-memory-start))
+    (make-list 1000 nil)
+    (make-vector 100 nil)
+    (should (profiler-memory-stop)))
+  (let* ((log (profiler-memory-type-log))
+         (conses (assq 'conses log))
+         (vectors (assq 'vectors log)))
+    (should (> (nth 1 conses) 0))
+    (should (hash-table-p (nth 2 conses)))
+    (should (> (hash-table-count (nth 2 conses)) 0))
+    (should (> (nth 1 vectors) 0)))
+  (should (not (profiler-memory-type-log)))
+  (profiler-memory-log))
+
 (provide 'profiler-tests)
 ;;; profiler-tests.el ends here
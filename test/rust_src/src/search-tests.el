@@ -0,0 +1,37 @@
+;;; search-tests.el --- Tests for search.rs
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'ert)
+
+(ert-deftest search-test--search-forward ()
+  ;; The last byte of the string is common in the first half of the
+  ;; buffer, and rare in the second half.
+  (with-temp-buffer
+    (insert (make-string 5000 ?e) "done\n" (make-string 5000 ?x) "done")
+    (goto-char (point-min))
+    (should (= (search-forward "done") 5005))
+    (should (= (search-forward "done") 10010))
+    (should-not (search-forward "done" nil t))
+    (should (= (search-backward "done") 10006))
+    (should (= (search-backward "done") 5001))
+    (goto-char (point-min))
+    (let ((case-fold-search t))
+      (should (= (search-forward "DONE") 5005)))))
+
+(ert-deftest search-test--search-forward-across-gap ()
+  (with-temp-buffer
+    (insert (make-string 100 ?x) "needle" (make-string 100 ?x))
+    ;; Leave the gap in the middle of "needle".
+    (goto-char 104)
+    (insert "y")
+    (delete-char -1)
+    (goto-char (point-min))
+    (should (= (search-forward "needle") 107))
+    (goto-char (point-min))
+    (should-not (search-forward "néédle" nil t))))
+
+(provide 'search-tests)
+;;; search-tests.el ends here
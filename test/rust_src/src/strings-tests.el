@@ -37,4 +37,20 @@
   ;; Test single unicode character with multiple code-points
   (should (eq (string-width "é") 1)))
 
+(ert-deftest multibyte-text-scanning ()
+  ;; Pad with ASCII so the non-ASCII text falls at different word
+  ;; offsets.
+  (dolist (pad '(0 1 7 8 9 31))
+    (let* ((ascii (make-string pad ?a))
+           (text (concat ascii "æøå" ascii "€" ascii))
+           (bytes (encode-coding-string text 'utf-8)))
+      (should (= (length (decode-coding-string bytes 'utf-8)) (length text)))
+      (should (= (length (string-as-multibyte bytes)) (length text)))
+      ;; Each of the 9 non-ASCII bytes becomes a 2-byte raw byte.
+      (should (= (string-bytes (string-to-multibyte bytes))
+                 (+ (length bytes) 9)))
+      (should (equal (decode-coding-string (concat ascii "\r\n" ascii)
+                                           'undecided)
+                     (concat ascii "\n" ascii))))))
+
 ;;; strings-tests ends here
@@ -51,3 +51,119 @@
     (should-not (eq x y))
     (dotimes (i 4)
       (should (eql (aref x i) (aref y i))))))
+
+(defun alloc-tests--used (type)
+  "Collect garbage and return the number of live objects of TYPE."
+  (nth 2 (assq type (garbage-collect))))
+
+(ert-deftest gc-sweep-frees-dead-conses-and-floats ()
+  (let* ((gc-cons-threshold most-positive-fixnum)
+         (lists (make-vector 100 nil))
+         (n (* 100 2000)))
+    (dotimes (i 100)
+      (aset lists i (mapcar (lambda (x) (* x 1.5)) (make-list 2000 i))))
+    (let ((conses (alloc-tests--used 'conses))
+          (floats (alloc-tests--used 'floats)))
+      (fillarray lists nil)
+      ;; Leave some slack for conservative stack scanning.
+      (should (<= (alloc-tests--used 'conses) (- conses (* 0.9 n))))
+      (should (<= (alloc-tests--used 'floats) (- floats (* 0.9 n)))))))
+
+(ert-deftest gc-sweep-threads-keeps-live-conses ()
+  (let* ((gc-sweep-threads 4)
+         (live (number-sequence 1 100000))
+         (copy (copy-sequence live)))
+    (dotimes (_ 10)
+      (make-list 10000 nil))
+    (garbage-collect)
+    (should (equal live copy))
+    (should (equal (length (make-list 10000 'x)) 10000))))
+
+(ert-deftest gc-sweep-threads-same-counts ()
+  (let ((gc-cons-threshold most-positive-fixnum)
+        (live (mapcar (lambda (x) (* x 1.5)) (make-list 200000 1))))
+    (cl-flet ((sweep (threads)
+                (let ((gc-sweep-threads threads))
+                  (dotimes (_ 10)
+                    (mapcar #'float (make-list 10000 1)))
+                  (let ((counts (garbage-collect)))
+                    (list (cddr (assq 'conses counts))
+                          (cddr (assq 'floats counts)))))))
+      (sweep 1)
+      (let* ((serial (sweep 1))
+             (parallel (sweep 4)))
+        ;; The conses holding SERIAL are the only new live objects.
+        (should (<= 0 (- (car (nth 0 parallel)) (car (nth 0 serial))) 100))
+        (should (= (apply #'+ (nth 0 serial)) (apply #'+ (nth 0 parallel))))
+        (should (equal (nth 1 serial) (nth 1 parallel)))))
+    (should (= (length live) 200000))))
+
+(ert-deftest gc-deeply-nested-structures ()
+  (let ((v nil)
+        (l nil))
+    (dotimes (_ 200000)
+      (setq v (vector v))
+      (setq l (cons l 1)))
+    (garbage-collect)
+    (should (vectorp v))
+    (should (consp l))))
+
+(ert-deftest malloc-trim-after-gc ()
+  (skip-unless (fboundp 'malloc-trim))
+  (cl-flet ((trims-after-garbage (threshold)
+              (let ((gc-malloc-trim-threshold threshold)
+                    (trims gc-malloc-trims))
+                (dotimes (_ 10)
+                  (make-vector 100000 nil))
+                (garbage-collect)
+                (- gc-malloc-trims trims))))
+    (should (= (trims-after-garbage nil) 0))
+    (should (= (trims-after-garbage most-positive-fixnum) 0))
+    (should (> (trims-after-garbage 0) 0))
+    (should (> (trims-after-garbage (* 1024 1024)) 0)))
+  (make-vector 1000000 nil)
+  (garbage-collect)
+  (should (memq (malloc-trim) '(t nil)))
+  (should (memq (malloc-trim 4096) '(t nil)))
+  (should-error (malloc-trim -1) :type 'wrong-type-argument))
+
+(ert-deftest gc-statistics-records-phases ()
+  (gc-statistics t)
+  (let* ((seen nil)
+         (gc-statistics-functions (list (lambda (r) (setq seen r)))))
+    (garbage-collect)
+    (should (floatp (car seen)))
+    (should (assq 'sweep-conses (cdr seen))))
+  ;; Automatic collections may happen at any point, so only check
+  ;; that the explicit one was recorded.
+  (let* ((count (lambda (stats)
+                  (apply #'+ (append (cdr (assq 'total (nth 1 stats))) nil))))
+         (before (gc-statistics))
+         (after (progn (garbage-collect) (gc-statistics)))
+         (recent (nth 0 after)))
+    (should (>= (length recent) (min 32 (1+ (length (nth 0 before))))))
+    (should (>= (funcall count after) (1+ (funcall count before))))
+    (should (>= (caar recent) 0))
+    (dolist (phase '(mark-roots mark-stack mark-other sweep-weak
+                     sweep-strings compact-strings sweep-conses
+                     sweep-floats sweep-intervals sweep-symbols
+                     sweep-misc sweep-buffers sweep-vectors))
+      (should (assq phase (cdar recent))))))
+
+(ert-deftest gc-target-pause-still-collects ()
+  (let ((gc-target-pause 0.01)
+        (gc-target-overhead 0.1)
+        (gcs gcs-done)
+        (n 0))
+    (garbage-collect)
+    (garbage-collect)
+    (while (and (< gcs-done (+ gcs 3)) (< n 10000))
+      (make-list 100000 nil)
+      (setq n (1+ n)))
+    (should (>= gcs-done (+ gcs 3))))
+  (let ((gcs gcs-done))
+    (let ((gc-target-pause 0.01)
+          (gc-cons-threshold most-positive-fixnum))
+      (dotimes (_ 100)
+        (make-list 100000 nil)))
+    (should (= gcs-done gcs))))
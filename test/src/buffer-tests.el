@@ -20,6 +20,7 @@
 ;;; Code:
 
 (require 'ert)
+(require 'cl-lib)
 
 (ert-deftest overlay-modification-hooks-message-other-buf ()
   "Test for bug#21824.
@@ -50,4 +51,107 @@ with parameters from the *Messages* buffer modification."
                             (progn (get-buffer-create "nil")
                                    (generate-new-buffer-name "nil")))))
 
+;; Recentering moves overlays between the before and after lists in
+;; bulk; queries must see the same overlays wherever the center is.
+(ert-deftest overlay-recenter-keeps-queries-consistent ()
+  (with-temp-buffer
+    (insert (make-string 2000 ?x))
+    (let ((ovs nil))
+      (dotimes (i 500)
+        (let ((beg (1+ (% (* i 37) 1990))))
+          (push (make-overlay beg (+ beg (% (* i 13) 50))) ovs)))
+      (dolist (center '(1 1000 2001 500 1500 1))
+        (overlay-recenter center)
+        (dolist (pos '(1 17 500 999 1000 1501 1999))
+          (should (= (length (overlays-at pos))
+                     (cl-count-if (lambda (ov)
+                                    (and (<= (overlay-start ov) pos)
+                                         (< pos (overlay-end ov))))
+                                  ovs))))
+        (should (= (length (overlays-in 1 2001)) (length ovs)))))))
+
+;; Far char/byte conversions in a multibyte buffer go through an index
+;; that edits must keep up to date.
+(ert-deftest buffer-position-bytes-after-edits ()
+  (with-temp-buffer
+    (dotimes (i 30000)
+      (insert (if (zerop (% i 7)) "\u4e2d" "a")))
+    (cl-flet ((check (pos)
+                (should (= (position-bytes pos)
+                           (1+ (string-bytes
+                                (buffer-substring-no-properties 1 pos)))))
+                (should (= (byte-to-position (position-bytes pos)) pos))))
+      (dolist (pos '(29000 20000 15000 25000))
+        (check pos))
+      (goto-char 12000)
+      (insert "\u00e9\u00e9")
+      (delete-region 18000 18100)
+      (dolist (pos '(29000 11999 12001 12003 17999 18000 25000))
+        (check pos))
+      (goto-char 16000)
+      (dotimes (_ 20)
+        (insert "\u4e2d"))
+      (delete-char -3)
+      (dolist (pos '(28000 16010 16017 22000))
+        (check pos))
+      (set-buffer-multibyte nil)
+      (set-buffer-multibyte t)
+      (dolist (pos '(28000 9000))
+        (check pos))
+      (transpose-regions 1 2 (- (point-max) 3) (point-max))
+      (dolist (pos (list 2 4 9000 20000 28000 (1- (point-max))))
+        (check pos)))))
+
+(ert-deftest buffer-line-index-after-edits ()
+  (with-temp-buffer
+    (dotimes (i 50000)
+      (insert (format "line %d%s\n" i (make-string (% i 13) ?x))))
+    (cl-flet ((check (pos)
+                (should (= (line-number-at-pos pos)
+                           (1+ (cl-count ?\n (buffer-substring-no-properties
+                                             1 pos)))))))
+      (dolist (pos '(1 200000 400000 100000 300000))
+        (check pos))
+      (goto-char 150000)
+      (insert "one\ntwo\n\nthree")
+      (delete-region 250000 260000)
+      (subst-char-in-region 320000 330000 ?\n ?y)
+      (dolist (pos '(149999 150010 150020 250000 255000 325000 400000))
+        (check pos))
+      (goto-char (point-min))
+      (should (= (forward-line 30000) 0))
+      (should (bolp))
+      (should (= (line-number-at-pos) 30001))
+      (should (= (forward-line -20000) 0))
+      (should (= (line-number-at-pos) 10001))
+      (let ((lines (line-number-at-pos (point-max))))
+        (goto-char (point-min))
+        (should (= (forward-line (+ lines 5000)) 5001)))
+      (let ((absolute (line-number-at-pos 200000)))
+        (narrow-to-region 100000 300000)
+        (should (= (line-number-at-pos 200000 t) absolute))
+        (should (= (line-number-at-pos 200000)
+                   (- absolute (line-number-at-pos 100000 t) -1)))))))
+
+;; Changed buffers keep a gap in proportion to their size across a GC;
+;; unchanged ones are shrunk, down to GAP_BYTES_MIN for tiny buffers.
+(ert-deftest buffer-gap-after-gc ()
+  (let ((gc-cons-threshold most-positive-fixnum))
+    (with-temp-buffer
+      (insert (make-string 800000 ?a))
+      (insert (make-string 3000 ?b))
+      (let ((grown (gap-size)))
+        (should (> grown (/ (buffer-size) 10)))
+        (garbage-collect)
+        (should (>= (gap-size) (/ (buffer-size) 8)))
+        ;; Whether gaps shrink at all depends on the malloc in use.
+        (skip-unless (< (gap-size) grown))
+        (garbage-collect)
+        (should (<= (gap-size) 2000))))
+    (with-temp-buffer
+      (insert (make-string 5000 ?a))
+      (delete-region 1 (- (point-max) 3))
+      (garbage-collect)
+      (should (<= (gap-size) 20)))))
+
 ;;; buffer-tests.el ends here
@@ -253,4 +253,82 @@
                  (buffer-string)
                  "foo bar baz qux"))))))
 
+(ert-deftest replace-buffer-contents-lines ()
+  (let ((source (generate-new-buffer "source")))
+    (unwind-protect
+        (progn
+          (with-current-buffer source
+            (dotimes (i 2000)
+              (insert (format "line %d %s\n" i
+                              (if (memq i '(10 1500)) "CHANGED" "same"))))
+            (insert "tail without newline"))
+          (with-temp-buffer
+            (dotimes (i 2000)
+              (insert (format "line %d same\n" i)))
+            (insert "tail")
+            (goto-char (point-min))
+            (forward-line 1000)
+            (put-text-property (point) (line-end-position) 'prop 'kept)
+            (let ((marker (point-marker))
+                  (text (buffer-substring (point) (line-end-position))))
+              (should (eq (replace-buffer-contents source) t))
+              (should (equal (buffer-string)
+                             (with-current-buffer source (buffer-string))))
+              (goto-char marker)
+              (should (equal (buffer-substring (point) (line-end-position))
+                             text))
+              (should (eq (get-text-property marker 'prop) 'kept))))
+          (with-temp-buffer
+            (insert "completely different")
+            (should-not (replace-buffer-contents source 0))
+            (should (equal (buffer-string)
+                           (with-current-buffer source (buffer-string))))))
+      (kill-buffer source))))
+
+(ert-deftest apply-buffer-edits ()
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert "alpha beta gamma delta")
+    (set-buffer-modified-p nil)
+    (let ((calls nil)
+          (marker (copy-marker 18)))
+      (add-hook 'before-change-functions
+                (lambda (beg end) (push (list 'before beg end) calls))
+                nil t)
+      (add-hook 'after-change-functions
+                (lambda (beg end len) (push (list 'after beg end len) calls))
+                nil t)
+      (undo-boundary)
+      (apply-buffer-edits [(12 17 "GAMMA") (1 6 "A") (7 7 "<") (7 7 ">")])
+      (should (equal (buffer-string) "A <>beta GAMMA delta"))
+      (should (= marker 16))
+      (should (equal (nreverse calls)
+                     '((before 1 17) (after 1 15 16))))
+      (undo-boundary)
+      (primitive-undo 1 (cdr buffer-undo-list))
+      (should (equal (buffer-string) "alpha beta gamma delta"))
+      (should-not (buffer-modified-p))))
+  ;; Enough edits that the replacements no longer fit on the stack,
+  ;; with a change function that drops them from EDITS.
+  (with-temp-buffer
+    (insert (make-string 2000 ?.))
+    (let* ((n 1000)
+           (edits (make-vector n nil)))
+      (dotimes (i n)
+        (aset edits i (list (+ 1 (* 2 i)) (+ 2 (* 2 i))
+                            (make-string 2 (+ ?a (% i 26))))))
+      (add-hook 'before-change-functions
+                (lambda (_beg _end)
+                  (fillarray edits nil)
+                  (garbage-collect))
+                nil t)
+      (apply-buffer-edits edits)
+      (should (= (buffer-size) 3000))
+      (should (equal (buffer-substring 1 7) "aa.bb.")))))
+  (with-temp-buffer
+    (insert "abc")
+    (should-error (apply-buffer-edits [(1 3 "x") (2 4 "y")]))
+    (should-error (apply-buffer-edits [(1 10 "x")]) :type 'args-out-of-range)
+    (should (equal (buffer-string) "abc"))))
+
 ;;; editfns-tests.el ends here
@@ -457,4 +457,19 @@
   (should-error (nconc (cyc1 1) 'tail) :type 'circular-list)
   (should-error (nconc (cyc2 1 2) 'tail) :type 'circular-list))
 
+;; Conversions in a long multibyte string use a sparse index once the
+;; same string is converted repeatedly; it must follow `aset'.
+(ert-deftest test-long-multibyte-string-aref ()
+  (let* ((n 20000)
+         (chars (vconcat (mapcar (lambda (i) (if (zerop (% i 5)) ?\u4e2d ?a))
+                                 (number-sequence 0 (1- n)))))
+         (s (concat chars)))
+    (dolist (i '(19999 17 15000 3 10001 9999 12345 0))
+      (should (eq (aref s i) (aref chars i))))
+    (aset s 100 ?\u00e9)
+    (aset chars 100 ?\u00e9)
+    (dolist (i '(15000 101 100 19995 7000))
+      (should (eq (aref s i) (aref chars i))))
+    (should (equal (substring s 14000 14010) (concat (substring chars 14000 14010))))))
+
 (provide 'fns-tests)
@@ -683,4 +683,83 @@ This evaluates the TESTS test cases from glibc."
   (should-not (string-match "\\`x\\{65535\\}" (make-string 65534 ?x)))
   (should-error (string-match "\\`x\\{65536\\}" "X") :type 'invalid-regexp))
 
+(ert-deftest regex-nested-repetition ()
+  "Test patterns that would make a backtracking matcher blow up."
+  (let ((str (make-string 200 ?a)))
+    (should-not (string-match "\\(a*\\)*b" str))
+    (should-not (string-match "\\(a\\|aa\\)*b" str))
+    (should (eq (string-match "\\(a*\\)*$" str) 0))
+    (should (equal (match-data) '(0 200 200 200)))
+    (should (eq (string-match "\\(a\\|aa\\)+\\(c\\)?" (concat str "c")) 0))
+    (should (equal (match-data) '(0 201 199 200 200 201)))))
+
+(ert-deftest regex-literal-prefix ()
+  "Test searching for regexps that start with a string."
+  (with-temp-buffer
+    (insert (make-string 1000 ?x) "été ERROR: disk full\nERRORS\n")
+    (goto-char (point-min))
+    (should (re-search-forward "ERROR: \\(.*\\)" nil t))
+    (should (equal (match-string 1) "disk full"))
+    (should (re-search-forward "\\(ERR\\)OR" nil t))
+    (should (= (match-beginning 0) (+ (point-min) 1000 4 17)))
+    (goto-char (point-min))
+    (should (re-search-forward "été" nil t))
+    (should (= (match-beginning 0) 1001))
+    (let ((case-fold-search t))
+      (should (re-search-forward "errors" nil t))))
+  (should (string-match "ab+c" (string-to-unibyte "\377abbc")))
+  (should (= (match-beginning 0) 1))
+  (should-not (string-match "abd" "abcabcab")))
+
+(ert-deftest regex-cache ()
+  "Test the compiled regexp cache."
+  (let ((regexp-cache-size 4)
+        (regexp-cache-hits 0)
+        (regexp-cache-misses 0)
+        (regexps (mapcar (lambda (i) (format "x\\{%d\\}y" i))
+                         (number-sequence 1 6))))
+    (should (string-match (car regexps) "xy"))
+    (should (string-match (car regexps) "xy"))
+    (should (= regexp-cache-misses 1))
+    (should (= regexp-cache-hits 1))
+    ;; Fill the cache past its size, so the first regexp is dropped.
+    (dolist (re regexps)
+      (should-not (string-match re "z")))
+    (should (= regexp-cache-misses 6))
+    (should (string-match (car regexps) "xy"))
+    (should (= regexp-cache-misses 7))
+    ;; A different translate table makes a different entry.
+    (let ((case-fold-search t))
+      (should (string-match (car regexps) "XY")))
+    (should (= regexp-cache-misses 8))))
+
+(ert-deftest regex-search-buffers ()
+  "Test `re-search-buffers'."
+  (let ((a (generate-new-buffer "a"))
+        (b (generate-new-buffer "b"))
+        (dead (generate-new-buffer "dead")))
+    (unwind-protect
+        (progn
+          (with-current-buffer a
+            (insert "foo bar foo\nbaz foo")
+            (narrow-to-region 2 (point-max)))
+          (with-current-buffer b
+            (insert "FOO fóo")
+            (setq-local case-fold-search t))
+          (kill-buffer dead)
+          (string-match "x" "x")
+          (should (equal (re-search-buffers "f\\(o\\)+" (list a b dead "a foo"))
+                         '(((9 . 12) (17 . 20))
+                           ((1 . 4))
+                           nil
+                           ((2 . 5)))))
+          ;; The match data is left alone.
+          (should (equal (match-data) '(0 1)))
+          (should (equal (re-search-buffers "o" (list a) 2)
+                         '(((2 . 3) (3 . 4)))))
+          (should (equal (re-search-buffers "o*" (list "xoo"))
+                         '(((0 . 0) (1 . 3) (3 . 3))))))
+      (kill-buffer a)
+      (kill-buffer b))))
+
 ;;; regex-tests.el ends here
@@ -68,5 +68,20 @@
     (should (and (equal-including-properties (pop stack) string)
 		 (null stack)))))
 
+(ert-deftest textprop-tests-copy-many-intervals ()
+  (with-temp-buffer
+    (dotimes (i 3000)
+      (insert (propertize (make-string (1+ (% i 5)) ?x) 'n i)))
+    (let* ((beg 7) (end (- (point-max) 4))
+           (copy (buffer-substring beg end)))
+      (should (= (length copy) (- end beg)))
+      (dotimes (k (length copy))
+        (should (eq (get-text-property k 'n copy)
+                    (get-text-property (+ beg k) 'n))))
+      (let ((changes 0) (pos 0))
+        (while (setq pos (next-single-property-change pos 'n copy))
+          (setq changes (1+ changes)))
+        (should (= changes 2996))))))
+
 (provide 'textprop-tests)
 ;; textprop-tests.el ends here.
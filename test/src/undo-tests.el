@@ -437,6 +437,28 @@ Demonstrates bug 16818."
 
     (should (string= (buffer-string) "aaaFirst line\nSecond line\nbbb"))))
 
+(ert-deftest undo-test-merge-deletions ()
+  "Test that consecutive deletions share one undo record."
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert "abcdefghij")
+    (undo-boundary)
+    (delete-char -1)
+    (delete-char -1)
+    (delete-char -1)
+    (should (equal (car buffer-undo-list) '("hij" . -8)))
+    (undo-boundary)
+    (goto-char (point-min))
+    (delete-char 1)
+    (delete-char 2)
+    (should (equal (car buffer-undo-list) '("abc" . 1)))
+    (undo-boundary)
+    (should (string= (buffer-string) "defg"))
+    (undo)
+    (undo-more 1)
+    (should (string= (buffer-string) "abcdefghij"))
+    (should (= (point) 11))))
+
 (defun undo-test-all (&optional interactive)
   "Run all tests for \\[undo]."
   (interactive "p")